@@ -0,0 +1,19 @@
+#include "catalogue_store.h"
+
+namespace transport {
+
+	CatalogueVersion::CatalogueVersion(CatalogueSnapshot&& snapshot, RouterSettings settings) :
+		catalogue(std::move(snapshot)), routing_settings(settings), router(settings, catalogue) {
+	}
+
+	std::shared_ptr<const CatalogueVersion> CatalogueStore::Acquire() const {
+		return current_.load(std::memory_order_acquire);
+	}
+
+	void CatalogueStore::Publish(CatalogueSnapshot&& snapshot, RouterSettings settings) {
+		// Граф маршрутизатора строится до публикации, читатели в это время продолжают работать с прежней версией
+		auto next = std::make_shared<const CatalogueVersion>(std::move(snapshot), settings);
+		current_.store(std::move(next), std::memory_order_release);
+	}
+
+}
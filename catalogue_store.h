@@ -0,0 +1,40 @@
+#pragma once
+
+#include "transport_catalogue.h"
+#include "transport_router.h"
+
+#include <atomic>
+#include <memory>
+
+namespace transport {
+
+	// Согласованная пара: снимок справочника и маршрутизатор, построенный по этому снимку
+	struct CatalogueVersion {
+		CatalogueVersion(CatalogueSnapshot&& snapshot, RouterSettings settings);
+
+		CatalogueVersion(const CatalogueVersion&) = delete;
+		CatalogueVersion& operator=(const CatalogueVersion&) = delete;
+
+		const CatalogueSnapshot catalogue;
+		const RouterSettings routing_settings;
+		const TransportRouter router;
+	};
+
+	// Публикует версии справочника по схеме RCU.
+	// Читатель закрепляет текущую версию атомарной загрузкой указателя и дальше работает с ней без блокировок.
+	// Сама загрузка не lock-free: libstdc++ реализует std::atomic<std::shared_ptr> с короткой внутренней
+	// спин-блокировкой, которую читатель держит, пока увеличивает счётчик ссылок.
+	// Писатель строит следующую версию в стороне и подменяет указатель атомарно.
+	// Старая версия освобождается, когда её отпускает последний читатель.
+	class CatalogueStore {
+	public:
+
+		std::shared_ptr<const CatalogueVersion> Acquire() const;
+
+		void Publish(CatalogueSnapshot&& snapshot, RouterSettings settings);
+
+	private:
+		std::atomic<std::shared_ptr<const CatalogueVersion>> current_;
+	};
+
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+// Векторные пути на AVX2 компилируются отдельными функциями с атрибутом target и выбираются во время
+// выполнения по CPUID. Поэтому сборка без -mavx2 использует их на процессорах, которые их поддерживают,
+// и остаётся работоспособной на остальных. Атрибут target есть только у GCC и Clang для x86
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define CPU_DISPATCH_AVX2
+#define CPU_TARGET_AVX2 __attribute__((target("avx2")))
+#define CPU_TARGET_AVX2_FMA __attribute__((target("avx2,fma")))
+#endif
+
+namespace cpu {
+
+    // Поддерживает ли процессор AVX2. Проверка выполняется один раз при первом вызове
+    inline bool HasAvx2() {
+#ifdef CPU_DISPATCH_AVX2
+        static const bool result = __builtin_cpu_supports("avx2");
+        return result;
+#else
+        return false;
+#endif
+    }
+
+    // Поддерживает ли процессор AVX2 вместе с FMA
+    inline bool HasAvx2Fma() {
+#ifdef CPU_DISPATCH_AVX2
+        static const bool result = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        return result;
+#else
+        return false;
+#endif
+    }
+
+}
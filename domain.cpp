@@ -15,16 +15,30 @@
 
 namespace domain {
 
-	Stop::Stop(const std::string& name, const transport::geo::Coordinates& coordinate) :
-		name_(name), coordinate_(coordinate) {}
+	Stop::Stop(std::string_view name, const transport::geo::Coordinates& coordinate, const allocator_type& alloc) :
+		name_(name, alloc), coordinate_(coordinate) {}
 
-	Bus::Bus(const std::string& name, const std::vector<const Stop*>& stops) :
-		is_circular_(true), name_(name), stops_(stops) {
+	Stop::Stop(const Stop& other, const allocator_type& alloc) :
+		id_(other.id_), name_(other.name_, alloc), coordinate_(other.coordinate_) {}
+
+	Stop::Stop(Stop&& other, const allocator_type& alloc) :
+		id_(other.id_), name_(std::move(other.name_), alloc), coordinate_(other.coordinate_) {}
+
+	Bus::Bus(const allocator_type& alloc) :
+		name_(alloc), stops_(alloc) {
+	}
+
+	Bus::Bus(std::string_view name, const std::vector<const Stop*>& stops, const allocator_type& alloc) :
+		is_circular_(true), name_(name, alloc), stops_(stops.begin(), stops.end(), alloc) {
+	}
+
+	Bus::Bus(const Bus& other, const allocator_type& alloc) :
+		id_(other.id_), is_circular_(other.is_circular_), name_(other.name_, alloc), stops_(other.stops_, alloc) {
 	}
 
-	bool Bus::operator<(Bus& other) {
-		return std::lexicographical_compare(name_.begin(), name_.end(),
-			other.name_.begin(), other.name_.end());
+	Bus::Bus(Bus&& other, const allocator_type& alloc) :
+		id_(other.id_), is_circular_(other.is_circular_),
+		name_(std::move(other.name_), alloc), stops_(std::move(other.stops_), alloc) {
 	}
 
 	BusInfo::BusInfo(size_t stops_count, size_t unique_stops_count, double route_length, double curvature) :
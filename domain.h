@@ -13,38 +13,126 @@
  */
 
 #include "geo.h"
+#include "ranges.h"
 
-#include <set>
+#include <cstddef>
+#include <iterator>
+#include <memory_resource>
 #include <string>
+#include <string_view>
 #include <vector>
 
 
 namespace domain {
 
+	// Остановка и маршрут поддерживают полиморфные аллокаторы: pmr-контейнеры справочника
+	// передают им свой ресурс памяти, и имена со списками остановок размещаются в арене справочника
 	struct Stop
 	{
-		Stop() = default;
+		using allocator_type = std::pmr::polymorphic_allocator<>;
 
-		Stop(const std::string& name, const transport::geo::Coordinates& coordinate);
+		Stop(std::string_view name, const transport::geo::Coordinates& coordinate, const allocator_type& alloc = {});
 
-		std::string name_;
+		Stop(const Stop& other) = default;
+		Stop(Stop&& other) = default;
+		Stop(const Stop& other, const allocator_type& alloc);
+		Stop(Stop&& other, const allocator_type& alloc);
+
+		Stop& operator=(const Stop& other) = default;
+		Stop& operator=(Stop&& other) = default;
+
+		size_t id_ = 0u;
+		std::pmr::string name_;
 		transport::geo::Coordinates coordinate_;
-		std::set<std::string_view> buses_by_stop_;
 	};
 
+	struct Bus;
+
+	// Итератор по полной последовательности остановок маршрута.
+	// Для некольцевого маршрута обратный ход не хранится, а вычисляется по индексу
+	class RouteIterator {
+	public:
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = const Stop*;
+		using difference_type = std::ptrdiff_t;
+		using pointer = const Stop* const*;
+		using reference = const Stop*;
+
+		RouteIterator() = default;
+		RouteIterator(const Bus* bus, size_t index) : bus_(bus), index_(index) {}
+
+		const Stop* operator*() const;
+
+		RouteIterator& operator++() {
+			++index_;
+			return *this;
+		}
+
+		RouteIterator operator++(int) {
+			RouteIterator result = *this;
+			++index_;
+			return result;
+		}
+
+		bool operator==(const RouteIterator& other) const = default;
+
+	private:
+		const Bus* bus_ = nullptr;
+		size_t index_ = 0u;
+	};
+
+	// Хранит только прямой ход маршрута. Для некольцевого маршрута (is_circular_ == false)
+	// полная последовательность остановок дополняется обратным ходом без последней остановки
 	struct Bus
 	{
+		using allocator_type = std::pmr::polymorphic_allocator<>;
+
 		Bus() = default;
 
-		Bus(const std::string& name, const std::vector<const Stop*>& stops);
+		explicit Bus(const allocator_type& alloc);
+
+		Bus(std::string_view name, const std::vector<const Stop*>& stops, const allocator_type& alloc = {});
+
+		Bus(const Bus& other) = default;
+		Bus(Bus&& other) = default;
+		Bus(const Bus& other, const allocator_type& alloc);
+		Bus(Bus&& other, const allocator_type& alloc);
+
+		Bus& operator=(const Bus& other) = default;
+		Bus& operator=(Bus&& other) = default;
 
-		bool operator<(Bus& other);
+		// Количество остановок с учётом обратного хода
+		size_t GetRouteSize() const {
+			if (stops_.empty() || is_circular_) {
+				return stops_.size();
+			}
+			return stops_.size() * 2 - 1;
+		}
 
+		// Остановка с номером index в полной последовательности
+		const Stop* GetRouteStop(size_t index) const {
+			return index < stops_.size() ? stops_[index] : stops_[GetRouteSize() - 1 - index];
+		}
+
+		ranges::Range<RouteIterator> GetRoute() const {
+			return { RouteIterator(this, 0u), RouteIterator(this, GetRouteSize()) };
+		}
+
+		// Конечная остановка прямого хода
+		const Stop* GetLastStop() const {
+			return stops_.back();
+		}
+
+		size_t id_ = 0u;
 		bool is_circular_;
-		std::string name_;
-		std::vector<const Stop*> stops_;
+		std::pmr::string name_;
+		std::pmr::vector<const Stop*> stops_;
 	};
 
+	inline const Stop* RouteIterator::operator*() const {
+		return bus_->GetRouteStop(index_);
+	}
+
 	struct BusInfo {
 		BusInfo() = default;
 
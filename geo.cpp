@@ -1,11 +1,50 @@
 #define _USE_MATH_DEFINES
 #include "geo.h"
+#include "cpu_features.h"
 
+#include <algorithm>
 #include <cmath>
+#include <limits>
+
+#ifdef CPU_DISPATCH_AVX2
+#include <immintrin.h>
+#endif
 
 namespace transport {
     namespace geo {
 
+        namespace {
+            const double dr = 3.1415926535 / 180.;
+            const int earth_radius = 6371000;
+
+#ifdef __FMA__
+            constexpr bool fused_multiply_add = true;
+#else
+            constexpr bool fused_multiply_add = false;
+#endif
+
+            // Косинус центрального угла между точками. При Fused умножение со сложением выполняется
+            // явно одной операцией, чтобы скалярный и векторный пути округляли одинаково
+            template <bool Fused = fused_multiply_add>
+            inline double AngleCos(double sin_from, double sin_to, double cos_from, double cos_to, double cos_lng) {
+                if constexpr (Fused) {
+                    return std::fma(sin_from, sin_to, cos_from * cos_to * cos_lng);
+                } else {
+                    return sin_from * sin_to + cos_from * cos_to * cos_lng;
+                }
+            }
+
+            // Косинус разности углов a и b по их синусам и косинусам; округляется так же, как в векторном пути
+            template <bool Fused = fused_multiply_add>
+            inline double DifferenceCos(double sin_a, double sin_b, double cos_a, double cos_b) {
+                if constexpr (Fused) {
+                    return std::fma(cos_a, cos_b, sin_a * sin_b);
+                } else {
+                    return cos_a * cos_b + sin_a * sin_b;
+                }
+            }
+        }
+
         Coordinates::Coordinates(double latitude, double longitude) :
             lat(latitude), lng(longitude) {}
 
@@ -23,19 +62,254 @@ namespace transport {
                 return 0;
             }
 
-            static const double dr = 3.1415926535 / 180.;
-            static const int earth_radius = 6371000;
-
-            return acos(sin(from.lat * dr) * sin(to.lat * dr)
-                + cos(from.lat * dr) * cos(to.lat * dr) * cos(abs(from.lng - to.lng) * dr))
+            return acos(AngleCos(sin(from.lat * dr), sin(to.lat * dr),
+                cos(from.lat * dr), cos(to.lat * dr), cos(abs(from.lng - to.lng) * dr)))
                 * earth_radius;
         }
 
-        std::size_t CoordinateHasher::operator()(const Coordinates& coords) const
-        {
-            return static_cast<std::size_t>(coords.lat + 17 * coords.lng);
+        // ---------- BoundingBox ------------------
+
+        BoundingBox BoundingBox::Empty() {
+            const double infinity = std::numeric_limits<double>::infinity();
+            return { infinity, infinity, -infinity, -infinity };
+        }
+
+        bool BoundingBox::IsValid() const {
+            return min_lat <= max_lat && min_lng <= max_lng;
+        }
+
+        bool BoundingBox::Contains(Coordinates point) const {
+            return point.lat >= min_lat && point.lat <= max_lat
+                && point.lng >= min_lng && point.lng <= max_lng;
+        }
+
+        bool BoundingBox::Intersects(const BoundingBox& other) const {
+            return other.min_lat <= max_lat && other.max_lat >= min_lat
+                && other.min_lng <= max_lng && other.max_lng >= min_lng;
+        }
+
+        void BoundingBox::Extend(Coordinates point) {
+            min_lat = std::min(min_lat, point.lat);
+            max_lat = std::max(max_lat, point.lat);
+            min_lng = std::min(min_lng, point.lng);
+            max_lng = std::max(max_lng, point.lng);
+        }
+
+        BoundingBox GetTileBounds(int zoom, int x, int y) {
+            const double tiles = std::ldexp(1., zoom);
+            const auto latitude = [tiles](int row) {
+                return std::atan(std::sinh(M_PI * (1. - 2. * row / tiles))) * 180. / M_PI;
+            };
+            return { latitude(y + 1), x / tiles * 360. - 180., latitude(y), (x + 1) / tiles * 360. - 180. };
+        }
+
+        double MercatorY(double lat) {
+            return std::log(std::tan(M_PI / 4. + lat * M_PI / 360.)) * 180. / M_PI;
+        }
+
+        // ---------- SimplifyPolyline ------------------
+
+        namespace {
+            // Квадрат расстояния от точки до отрезка на плоскости долгота-широта
+            double SegmentDistanceSquared(Coordinates point, Coordinates from, Coordinates to) {
+                const double dx = to.lng - from.lng;
+                const double dy = to.lat - from.lat;
+                double px = point.lng - from.lng;
+                double py = point.lat - from.lat;
+
+                const double length = dx * dx + dy * dy;
+                if (length > 0.) {
+                    const double t = std::clamp((px * dx + py * dy) / length, 0., 1.);
+                    px -= t * dx;
+                    py -= t * dy;
+                }
+                return px * px + py * py;
+            }
+        }
+
+        std::vector<uint32_t> SimplifyPolyline(std::span<const Coordinates> points, double tolerance) {
+            std::vector<uint32_t> kept;
+            if (points.size() <= 2) {
+                for (uint32_t i = 0; i < points.size(); ++i) {
+                    kept.push_back(i);
+                }
+                return kept;
+            }
+
+            // Отрезки обрабатываются через явный стек, чтобы длинная ломаная не переполняла стек вызовов
+            std::vector<bool> keep(points.size(), false);
+            keep.front() = keep.back() = true;
+            const double tolerance_squared = tolerance * tolerance;
+
+            std::vector<std::pair<size_t, size_t>> ranges{ { 0u, points.size() - 1 } };
+            while (!ranges.empty()) {
+                const auto [first, last] = ranges.back();
+                ranges.pop_back();
+
+                double max_distance = 0.;
+                size_t farthest = first;
+                for (size_t i = first + 1; i < last; ++i) {
+                    const double distance = SegmentDistanceSquared(points[i], points[first], points[last]);
+                    if (distance > max_distance) {
+                        max_distance = distance;
+                        farthest = i;
+                    }
+                }
+
+                if (max_distance > tolerance_squared) {
+                    keep[farthest] = true;
+                    ranges.emplace_back(first, farthest);
+                    ranges.emplace_back(farthest, last);
+                }
+            }
+
+            for (uint32_t i = 0; i < points.size(); ++i) {
+                if (keep[i]) {
+                    kept.push_back(i);
+                }
+            }
+            return kept;
+        }
+
+        // ---------- CoordinatesTable ------------------
+
+        CoordinatesTable::CoordinatesTable(const allocator_type& alloc) :
+            sin_lat_(alloc), cos_lat_(alloc), sin_lng_(alloc), cos_lng_(alloc), lng_(alloc), lat_(alloc) {}
+
+        void CoordinatesTable::Reserve(size_t count) {
+            sin_lat_.reserve(count);
+            cos_lat_.reserve(count);
+            sin_lng_.reserve(count);
+            cos_lng_.reserve(count);
+            lng_.reserve(count);
+            lat_.reserve(count);
+        }
+
+        void CoordinatesTable::Clear() {
+            sin_lat_.clear();
+            cos_lat_.clear();
+            sin_lng_.clear();
+            cos_lng_.clear();
+            lng_.clear();
+            lat_.clear();
+        }
+
+        void CoordinatesTable::Add(Coordinates coords) {
+            sin_lat_.push_back(std::sin(coords.lat * dr));
+            cos_lat_.push_back(std::cos(coords.lat * dr));
+            sin_lng_.push_back(std::sin(coords.lng * dr));
+            cos_lng_.push_back(std::cos(coords.lng * dr));
+            lng_.push_back(coords.lng);
+            lat_.push_back(coords.lat);
+        }
+
+        void CoordinatesTable::AddFrom(const CoordinatesTable& other, size_t index) {
+            sin_lat_.push_back(other.sin_lat_[index]);
+            cos_lat_.push_back(other.cos_lat_[index]);
+            sin_lng_.push_back(other.sin_lng_[index]);
+            cos_lng_.push_back(other.cos_lng_[index]);
+            lng_.push_back(other.lng_[index]);
+            lat_.push_back(other.lat_[index]);
+        }
+
+        size_t CoordinatesTable::Size() const {
+            return lng_.size();
+        }
+
+        CoordinatesSoA CoordinatesTable::View() const {
+            return { sin_lat_.data(), cos_lat_.data(), sin_lng_.data(), cos_lng_.data(), lng_.data(), lat_.data() };
+        }
+
+        // ---------- ComputeDistances ------------------
+
+        namespace {
+
+            // Записывает в result[i] косинус угла между точками from[i] и to[i] для i из [first, count).
+            // При BroadcastFrom точка from одна и сравнивается со всеми точками to.
+            // Совпадающим точкам сразу присваивается косинус угла 1, арккосинус которого равен нулю
+            template <bool BroadcastFrom, bool Fused>
+            inline void ComputeAngleCos(CoordinatesSoA from, CoordinatesSoA to, size_t first, size_t count, double* result) {
+                for (size_t i = first; i < count; ++i) {
+                    const size_t f = BroadcastFrom ? size_t{ 0 } : i;
+                    const bool same_point = from.sin_lat[f] == to.sin_lat[i]
+                        && from.cos_lat[f] == to.cos_lat[i] && from.lng[f] == to.lng[i];
+
+                    result[i] = same_point ? 1.0
+                        : std::min(1.0, AngleCos<Fused>(from.sin_lat[f], to.sin_lat[i], from.cos_lat[f], to.cos_lat[i],
+                            DifferenceCos<Fused>(from.sin_lng[f], to.sin_lng[i], from.cos_lng[f], to.cos_lng[i])));
+                }
+            }
+
+#ifdef CPU_DISPATCH_AVX2
+            // Четыре значения from начиная с i; при BroadcastFrom одно значение, повторённое четыре раза
+            template <bool BroadcastFrom>
+            CPU_TARGET_AVX2 inline __m256d LoadFrom(const double* values, size_t i) {
+                return BroadcastFrom ? _mm256_broadcast_sd(values) : _mm256_loadu_pd(values + i);
+            }
+
+            // То же по четыре пары за раз. Остаток считается скалярно с FMA, чтобы пара давала один и тот же
+            // результат независимо от того, попала она в вектор или в остаток
+            template <bool BroadcastFrom>
+            CPU_TARGET_AVX2_FMA void ComputeAngleCosAvx2(CoordinatesSoA from, CoordinatesSoA to, size_t count, double* result) {
+                const __m256d one = _mm256_set1_pd(1.0);
+                size_t i = 0;
+                for (; i + 4 <= count; i += 4) {
+                    const __m256d sin_from = LoadFrom<BroadcastFrom>(from.sin_lat, i);
+                    const __m256d sin_to = _mm256_loadu_pd(to.sin_lat + i);
+                    const __m256d cos_from = LoadFrom<BroadcastFrom>(from.cos_lat, i);
+                    const __m256d cos_to = _mm256_loadu_pd(to.cos_lat + i);
+                    const __m256d sin_lng_from = LoadFrom<BroadcastFrom>(from.sin_lng, i);
+                    const __m256d sin_lng_to = _mm256_loadu_pd(to.sin_lng + i);
+                    const __m256d cos_lng_from = LoadFrom<BroadcastFrom>(from.cos_lng, i);
+                    const __m256d cos_lng_to = _mm256_loadu_pd(to.cos_lng + i);
+
+                    const __m256d cos_lng = _mm256_fmadd_pd(cos_lng_from, cos_lng_to, _mm256_mul_pd(sin_lng_from, sin_lng_to));
+                    const __m256d angle_cos = _mm256_fmadd_pd(sin_from, sin_to,
+                        _mm256_mul_pd(_mm256_mul_pd(cos_from, cos_to), cos_lng));
+
+                    const __m256d same_point = _mm256_and_pd(
+                        _mm256_and_pd(_mm256_cmp_pd(sin_from, sin_to, _CMP_EQ_OQ), _mm256_cmp_pd(cos_from, cos_to, _CMP_EQ_OQ)),
+                        _mm256_cmp_pd(LoadFrom<BroadcastFrom>(from.lng, i), _mm256_loadu_pd(to.lng + i), _CMP_EQ_OQ));
+
+                    // Округление может дать косинус чуть больше единицы, арккосинус которого не определён
+                    _mm256_storeu_pd(result + i, _mm256_blendv_pd(_mm256_min_pd(angle_cos, one), one, same_point));
+                }
+                ComputeAngleCos<BroadcastFrom, true>(from, to, i, count, result);
+            }
+#endif
+
+            template <bool BroadcastFrom>
+            void ComputeDistancesImpl(CoordinatesSoA from, CoordinatesSoA to, size_t count, double* result) {
+#ifdef CPU_DISPATCH_AVX2
+                if (cpu::HasAvx2Fma()) {
+                    ComputeAngleCosAvx2<BroadcastFrom>(from, to, count, result);
+                } else {
+                    ComputeAngleCos<BroadcastFrom, fused_multiply_add>(from, to, 0, count, result);
+                }
+#else
+                ComputeAngleCos<BroadcastFrom, fused_multiply_add>(from, to, 0, count, result);
+#endif
+
+                // Векторного арккосинуса в libm нет, поэтому он остаётся скалярным
+                for (size_t i = 0; i < count; ++i) {
+                    result[i] = std::acos(result[i]) * earth_radius;
+                }
+            }
+
+        }
+
+        void ComputeDistances(CoordinatesSoA from, CoordinatesSoA to, size_t count, double* result) {
+            ComputeDistancesImpl<false>(from, to, count, result);
+        }
+
+        void ComputeDistances(Coordinates from, CoordinatesSoA to, size_t count, double* result) {
+            const double sin_lat = std::sin(from.lat * dr);
+            const double cos_lat = std::cos(from.lat * dr);
+            const double sin_lng = std::sin(from.lng * dr);
+            const double cos_lng = std::cos(from.lng * dr);
+            ComputeDistancesImpl<true>({ &sin_lat, &cos_lat, &sin_lng, &cos_lng, &from.lng, &from.lat }, to, count, result);
         }
 
     }  // namespace geo
 
-} //namesapce transport
\ No newline at end of file
+} //namesapce transport
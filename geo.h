@@ -1,6 +1,11 @@
 #pragma once
 
 #include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <span>
+#include <vector>
 
 namespace transport {
     namespace geo {
@@ -18,10 +23,91 @@ namespace transport {
 
         double ComputeDistance(Coordinates from, Coordinates to);
 
-        class CoordinateHasher {
+        // Прямоугольник в координатах: границы входят в него
+        struct BoundingBox {
+            double min_lat = 0.;
+            double min_lng = 0.;
+            double max_lat = 0.;
+            double max_lng = 0.;
+
+            // Пустой прямоугольник, который расширяется первой же точкой
+            static BoundingBox Empty();
+
+            bool IsValid() const;
+            bool Contains(Coordinates point) const;
+            bool Intersects(const BoundingBox& other) const;
+
+            void Extend(Coordinates point);
+        };
+
+        // Границы тайла z/x/y в проекции Web Mercator: 2^z тайлов по каждой оси, x растёт на восток, y на юг
+        BoundingBox GetTileBounds(int zoom, int x, int y);
+
+        // Ордината широты lat в проекции Web Mercator в тех же единицах, что и долгота: на экваторе
+        // градус широты и градус долготы одинаковы, так что тайл в этих координатах квадратный
+        double MercatorY(double lat);
+
+        // Упрощает ломаную алгоритмом Дугласа — Пекера на плоскости долгота-широта и возвращает
+        // номера оставленных вершин по возрастанию. Крайние вершины остаются всегда, промежуточные —
+        // если отстоят от упрощённой линии больше чем на tolerance градусов
+        std::vector<uint32_t> SimplifyPolyline(std::span<const Coordinates> points, double tolerance);
+
+        // Представление набора точек в виде структуры массивов.
+        // Синусы и косинусы широты и долготы вычислены заранее: косинус разности долгот собирается
+        // из них по формуле cos(a - b) = cos a cos b + sin a sin b, так что на пару точек остаются
+        // несколько умножений и арккосинус. Сами долгота и широта нужны для проверки совпадения точек
+        // и попадания в прямоугольник
+        struct CoordinatesSoA {
+            const double* sin_lat = nullptr;
+            const double* cos_lat = nullptr;
+            const double* sin_lng = nullptr;
+            const double* cos_lng = nullptr;
+            const double* lng = nullptr;
+            const double* lat = nullptr;
+
+            CoordinatesSoA Shifted(size_t offset) const {
+                return { sin_lat + offset, cos_lat + offset, sin_lng + offset, cos_lng + offset, lng + offset, lat + offset };
+            }
+        };
+
+        // Хранилище точек в виде структуры массивов
+        class CoordinatesTable {
         public:
-            std::size_t operator()(const Coordinates& coords) const;
+            using allocator_type = std::pmr::polymorphic_allocator<>;
+
+            CoordinatesTable() = default;
+            explicit CoordinatesTable(const allocator_type& alloc);
+
+            void Reserve(size_t count);
+            void Clear();
+
+            void Add(Coordinates coords);
+
+            // Копирует точку из другой таблицы без повторного вычисления тригонометрии
+            void AddFrom(const CoordinatesTable& other, size_t index);
+
+            size_t Size() const;
+
+            CoordinatesSoA View() const;
+
+        private:
+            std::pmr::vector<double> sin_lat_;
+            std::pmr::vector<double> cos_lat_;
+            std::pmr::vector<double> sin_lng_;
+            std::pmr::vector<double> cos_lng_;
+            std::pmr::vector<double> lng_;
+            std::pmr::vector<double> lat_;
         };
 
+        // Вычисляет расстояния между точками from[i] и to[i] для i из [0, count) и записывает их в result.
+        // Результат совпадает с ComputeDistance с точностью до округления: косинус разности долгот получается
+        // из заранее вычисленных синусов и косинусов. Если процессор поддерживает AVX2 и FMA (проверяется при
+        // выполнении), всё, кроме арккосинуса, считается по четыре пары за раз; арккосинус вычисляется через libm
+        // по одному значению
+        void ComputeDistances(CoordinatesSoA from, CoordinatesSoA to, size_t count, double* result);
+
+        // То же для одной точки from и точек to[i]
+        void ComputeDistances(Coordinates from, CoordinatesSoA to, size_t count, double* result);
+
     }
-}
\ No newline at end of file
+}
@@ -56,11 +56,8 @@ namespace transport {
                 return Split(route, '>');
             }
 
-            auto stops = Split(route, '-');
-            std::vector<std::string_view> results(stops.begin(), stops.end());
-            results.insert(results.end(), std::next(stops.rbegin()), stops.rend());
-
-            return results;
+            // Обратный ход некольцевого маршрута справочник достраивает сам
+            return Split(route, '-');
         }
 
         CommandDescription ParseCommandDescription(std::string_view line) {
@@ -107,7 +104,7 @@ namespace transport {
             }
         }
 
-        void InputReader::FillDistances(TransportCatalogue& catalogue) const {
+        void InputReader::FillDistances(CatalogueBuilder& catalogue) const {
             for (const CommandDescription& command : commands_) {
                 if (command.command == "Stop") {
                     
@@ -117,14 +114,13 @@ namespace transport {
                     auto distances = ParseDistances(distances_str);
 
                     for (const auto& [neighbor_stop, distance] : distances) {
-                        catalogue.SetDistance(const_cast<domain::Stop*>(catalogue.GetStop(command.id)),
-                            const_cast<domain::Stop*>(catalogue.GetStop(neighbor_stop)), distance);
+                        catalogue.SetDistance(catalogue.GetStop(command.id), catalogue.GetStop(neighbor_stop), distance);
                     }
                 }
             }
         }
 
-        void InputReader::ApplyCommands(TransportCatalogue& catalogue) const {
+        void InputReader::ApplyCommands(CatalogueBuilder& catalogue) const {
             std::vector<CommandDescription> bus_commands;
 
             for (const CommandDescription& command : commands_) {
@@ -153,7 +149,10 @@ namespace transport {
                     bus_stops.push_back(catalogue.GetStop(stop));
                 }
 
-                catalogue.AddBus({ command.id, bus_stops });
+                domain::Bus bus{ command.id, bus_stops };
+                bus.is_circular_ = command.description.find('>') != command.description.npos;
+
+                catalogue.AddBus(std::move(bus));
             }
         }
 
@@ -161,7 +160,7 @@ namespace transport {
             return commands_;
         }
 
-        void FillCatalogue(std::istream& input, TransportCatalogue& catalogue) {
+        void FillCatalogue(std::istream& input, CatalogueBuilder& catalogue) {
             int base_request_count;
             input >> base_request_count >> std::ws;
 
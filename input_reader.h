@@ -30,8 +30,8 @@ namespace transport {
         public:
             void ParseLine(std::string_view line);
 
-            void FillDistances(TransportCatalogue& catalogue) const;
-            void ApplyCommands(TransportCatalogue& catalogue) const;
+            void FillDistances(CatalogueBuilder& catalogue) const;
+            void ApplyCommands(CatalogueBuilder& catalogue) const;
 
             std::vector<CommandDescription> GetCommands() const;
 
@@ -39,7 +39,7 @@ namespace transport {
             std::vector<CommandDescription> commands_;
         };
 
-        void FillCatalogue(std::istream& input, TransportCatalogue& catalogue);
+        void FillCatalogue(std::istream& input, CatalogueBuilder& catalogue);
 
         std::unordered_map<std::string, size_t> ParseDistances(std::string_view str);
     }
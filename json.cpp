@@ -1,45 +1,111 @@
 #include "json.h"
+#include "json_scanner.h"
 
-#include <iterator>
+#include <cctype>
+#include <charconv>
 
 namespace json {
 
     namespace {
         using namespace std::literals;
 
-        Node LoadNode(std::istream& input);
-        Node LoadString(std::istream& input);
+        inline bool IsSpace(char c) {
+            return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+        }
+
+        inline bool IsDigit(char c) {
+            return c >= '0' && c <= '9';
+        }
 
-        std::string LoadLiteral(std::istream& input) {
-            std::string s;
-            while (std::isalpha(input.peek())) {
-                s.push_back(static_cast<char>(input.get()));
+        // Позиция разбора внутри непрерывного буфера с входными данными.
+        // Переход к следующей лексеме идёт по структурному индексу, а не посимвольным пропуском пробелов
+        struct Input {
+            const char* data;
+            const char* pos;
+            const char* end;
+            const uint32_t* token;
+            const uint32_t* tokens_end;
+            bool from_index = false;
+
+            bool AtEnd() const {
+                return pos == end;
             }
-            return s;
+
+            // Возвращает первый символ очередной лексемы; при достижении конца буфера возвращает false.
+            // Лексемы, уже поглощённые разбором строк, чисел и литералов, пропускаются
+            bool NextChar(char& c) {
+                while (token != tokens_end && data + *token < pos) {
+                    ++token;
+                }
+
+                // Индекс хранит только начало значения, поэтому символ, вплотную примыкающий
+                // к разобранному числу или литералу, читается напрямую
+                from_index = pos == end || IsSpace(*pos) || (token != tokens_end && data + *token == pos);
+                if (!from_index) {
+                    c = *pos++;
+                    return true;
+                }
+
+                if (token == tokens_end) {
+                    pos = end;
+                    return false;
+                }
+                pos = data + *token++;
+                c = *pos++;
+                return true;
+            }
+
+            // Возвращает последний символ, прочитанный NextChar
+            void PutBack() {
+                --pos;
+                if (from_index) {
+                    --token;
+                }
+            }
+        };
+
+        Node LoadNode(Input& input);
+        std::string LoadString(Input& input);
+
+        std::string_view LoadLiteral(Input& input) {
+            const char* begin = input.pos;
+            while (!input.AtEnd() && std::isalpha(static_cast<unsigned char>(*input.pos))) {
+                ++input.pos;
+            }
+            return { begin, static_cast<size_t>(input.pos - begin) };
         }
 
-        Node LoadArray(std::istream& input) {
+        Node LoadArray(Input& input) {
             std::vector<Node> result;
+            bool closed = false;
 
-            for (char c; input >> c && c != ']';) {
+            for (char c; !closed && input.NextChar(c);) {
+                if (c == ']') {
+                    closed = true;
+                    continue;
+                }
                 if (c != ',') {
-                    input.putback(c);
+                    input.PutBack();
                 }
                 result.push_back(LoadNode(input));
             }
-            if (!input) {
+            if (!closed) {
                 throw ParsingError("Array parsing error"s);
             }
             return Node(std::move(result));
         }
 
-        Node LoadDict(std::istream& input) {
+        Node LoadDict(Input& input) {
             Dict dict;
+            bool closed = false;
 
-            for (char c; input >> c && c != '}';) {
-                if (c == '"') {
-                    std::string key = LoadString(input).AsString();
-                    if (input >> c && c == ':') {
+            for (char c; !closed && input.NextChar(c);) {
+                if (c == '}') {
+                    closed = true;
+                }
+                else if (c == '"') {
+                    std::string key = LoadString(input);
+                    if (input.NextChar(c) && c == ':') {
                         if (dict.find(key) != dict.end()) {
                             throw ParsingError("Duplicate key '"s + key + "' have been found");
                         }
@@ -53,31 +119,51 @@ namespace json {
                     throw ParsingError(R"(',' is expected but ')"s + c + "' has been found"s);
                 }
             }
-            if (!input) {
+            if (!closed) {
                 throw ParsingError("Dictionary parsing error"s);
             }
             return Node(std::move(dict));
         }
 
-        Node LoadString(std::istream& input) {
-            auto it = std::istreambuf_iterator<char>(input);
-            auto end = std::istreambuf_iterator<char>();
-            std::string s;
+        // Возвращает содержимое строки. Строка без экранирования возвращается как представление входного буфера,
+        // иначе она раскодируется в buffer
+        std::string_view ReadString(Input& input, std::string& buffer) {
+            // Тело строки не содержит лексем, поэтому следующая лексема индекса — закрывающая кавычка
+            const char* close = nullptr;
+            while (input.token != input.tokens_end && input.data + *input.token < input.pos) {
+                ++input.token;
+            }
+            if (input.token != input.tokens_end) {
+                close = input.data + *input.token;
+            }
+            const char* limit = close ? close : input.end;
+
+            std::string& s = buffer;
+            s.clear();
+            const char* pos = input.pos;
+
+            // Участок без экранирования и переводов строки копируется целиком
+            const char* special = FindStringSpecial(pos, limit);
+            if (special == limit && close) {
+                input.pos = close + 1;
+                ++input.token;
+                return { pos, static_cast<size_t>(close - pos) };
+            }
+
             while (true) {
-                if (it == end) {
-                    throw ParsingError("String parsing error");
-                }
-                const char ch = *it;
-                if (ch == '"') {
-                    ++it;
+                s.append(pos, special);
+
+                if (special == limit) {
+                    if (!close) {
+                        throw ParsingError("String parsing error");
+                    }
                     break;
                 }
-                else if (ch == '\\') {
-                    ++it;
-                    if (it == end) {
+                else if (*special == '\\') {
+                    if (special + 1 == input.end) {
                         throw ParsingError("String parsing error");
                     }
-                    const char escaped_char = *(it);
+                    const char escaped_char = special[1];
                     switch (escaped_char) {
                     case 'n':
                         s.push_back('\n');
@@ -97,20 +183,26 @@ namespace json {
                     default:
                         throw ParsingError("Unrecognized escape sequence \\"s + escaped_char);
                     }
-                }
-                else if (ch == '\n' || ch == '\r') {
-                    throw ParsingError("Unexpected end of line"s);
+                    pos = special + 2;
+                    special = FindStringSpecial(pos, limit);
                 }
                 else {
-                    s.push_back(ch);
+                    throw ParsingError("Unexpected end of line"s);
                 }
-                ++it;
             }
 
-            return Node(std::move(s));
+            input.pos = close + 1;
+            ++input.token;
+            return s;
+        }
+
+        std::string LoadString(Input& input) {
+            std::string buffer;
+            const std::string_view s = ReadString(input, buffer);
+            return s.data() == buffer.data() ? std::move(buffer) : std::string(s);
         }
 
-        Node LoadBool(std::istream& input) {
+        Node LoadBool(Input& input) {
             const auto s = LoadLiteral(input);
             if (s == "true"sv) {
                 return Node{ true };
@@ -119,46 +211,42 @@ namespace json {
                 return Node{ false };
             }
             else {
-                throw ParsingError("Failed to parse '"s + s + "' as bool"s);
+                throw ParsingError("Failed to parse '"s + std::string(s) + "' as bool"s);
             }
         }
 
-        Node LoadNull(std::istream& input) {
+        Node LoadNull(Input& input) {
             if (auto literal = LoadLiteral(input); literal == "null"sv) {
                 return Node{ nullptr };
             }
             else {
-                throw ParsingError("Failed to parse '"s + literal + "' as null"s);
+                throw ParsingError("Failed to parse '"s + std::string(literal) + "' as null"s);
             }
         }
 
-        Node LoadNumber(std::istream& input) {
-            std::string parsed_num;
+        Node LoadNumber(Input& input) {
+            const char* begin = input.pos;
 
-            // Считывает в parsed_num очередной символ из input
-            auto read_char = [&parsed_num, &input] {
-                parsed_num += static_cast<char>(input.get());
-                if (!input) {
-                    throw ParsingError("Failed to read number from stream"s);
-                }
-                };
+            auto peek = [&input] {
+                return input.AtEnd() ? '\0' : *input.pos;
+            };
 
-            // Считывает одну или более цифр в parsed_num из input
-            auto read_digits = [&input, read_char] {
-                if (!std::isdigit(input.peek())) {
+            // Пропускает одну или более цифр
+            auto read_digits = [&input, peek] {
+                if (!IsDigit(peek())) {
                     throw ParsingError("A digit is expected"s);
                 }
-                while (std::isdigit(input.peek())) {
-                    read_char();
+                while (IsDigit(peek())) {
+                    ++input.pos;
                 }
-                };
+            };
 
-            if (input.peek() == '-') {
-                read_char();
+            if (peek() == '-') {
+                ++input.pos;
             }
             // Парсим целую часть числа
-            if (input.peek() == '0') {
-                read_char();
+            if (peek() == '0') {
+                ++input.pos;
                 // После 0 в JSON не могут идти другие цифры
             }
             else {
@@ -167,43 +255,41 @@ namespace json {
 
             bool is_int = true;
             // Парсим дробную часть числа
-            if (input.peek() == '.') {
-                read_char();
+            if (peek() == '.') {
+                ++input.pos;
                 read_digits();
                 is_int = false;
             }
 
             // Парсим экспоненциальную часть числа
-            if (int ch = input.peek(); ch == 'e' || ch == 'E') {
-                read_char();
-                if (ch = input.peek(); ch == '+' || ch == '-') {
-                    read_char();
+            if (char ch = peek(); ch == 'e' || ch == 'E') {
+                ++input.pos;
+                if (ch = peek(); ch == '+' || ch == '-') {
+                    ++input.pos;
                 }
                 read_digits();
                 is_int = false;
             }
 
-            try {
-                if (is_int) {
-                    // Сначала пробуем преобразовать строку в int
-                    try {
-                        return std::stoi(parsed_num);
-                    }
-                    catch (...) {
-                        // В случае неудачи, например, при переполнении
-                        // код ниже попробует преобразовать строку в double
-                    }
+            // Границы числа уже проверены, from_chars разбирает его без копирования и без учёта локали
+            if (is_int) {
+                int value = 0;
+                if (const auto [ptr, ec] = std::from_chars(begin, input.pos, value); ec == std::errc{}) {
+                    return value;
                 }
-                return std::stod(parsed_num);
+                // При переполнении int код ниже преобразует число в double
             }
-            catch (...) {
-                throw ParsingError("Failed to convert "s + parsed_num + " to number"s);
+
+            double value = 0.;
+            if (const auto [ptr, ec] = std::from_chars(begin, input.pos, value); ec != std::errc{}) {
+                throw ParsingError("Failed to convert "s + std::string(begin, input.pos) + " to number"s);
             }
+            return value;
         }
 
-        Node LoadNode(std::istream& input) {
+        Node LoadNode(Input& input) {
             char c;
-            if (!(input >> c)) {
+            if (!input.NextChar(c)) {
                 throw ParsingError("Unexpected EOF"s);
             }
             switch (c) {
@@ -222,17 +308,117 @@ namespace json {
                 // литералов true либо false
                 [[fallthrough]];
             case 'f':
-                input.putback(c);
+                input.PutBack();
                 return LoadBool(input);
             case 'n':
-                input.putback(c);
+                input.PutBack();
                 return LoadNull(input);
             default:
-                input.putback(c);
+                input.PutBack();
                 return LoadNumber(input);
             }
         }
 
+        void ParseNode(Input& input, SaxHandler& handler, std::string& buffer);
+
+        void ParseArray(Input& input, SaxHandler& handler, std::string& buffer) {
+            handler.StartArray();
+            bool closed = false;
+
+            for (char c; !closed && input.NextChar(c);) {
+                if (c == ']') {
+                    closed = true;
+                    continue;
+                }
+                if (c != ',') {
+                    input.PutBack();
+                }
+                ParseNode(input, handler, buffer);
+            }
+            if (!closed) {
+                throw ParsingError("Array parsing error"s);
+            }
+            handler.EndArray();
+        }
+
+        void ParseDict(Input& input, SaxHandler& handler, std::string& buffer) {
+            handler.StartDict();
+            bool closed = false;
+
+            for (char c; !closed && input.NextChar(c);) {
+                if (c == '}') {
+                    closed = true;
+                }
+                else if (c == '"') {
+                    handler.Key(ReadString(input, buffer));
+                    if (input.NextChar(c) && c == ':') {
+                        ParseNode(input, handler, buffer);
+                    }
+                    else {
+                        throw ParsingError(": is expected but '"s + c + "' has been found"s);
+                    }
+                }
+                else if (c != ',') {
+                    throw ParsingError(R"(',' is expected but ')"s + c + "' has been found"s);
+                }
+            }
+            if (!closed) {
+                throw ParsingError("Dictionary parsing error"s);
+            }
+            handler.EndDict();
+        }
+
+        void ParseNode(Input& input, SaxHandler& handler, std::string& buffer) {
+            char c;
+            if (!input.NextChar(c)) {
+                throw ParsingError("Unexpected EOF"s);
+            }
+            switch (c) {
+            case '[':
+                ParseArray(input, handler, buffer);
+                break;
+            case '{':
+                ParseDict(input, handler, buffer);
+                break;
+            case '"':
+                handler.String(ReadString(input, buffer));
+                break;
+            case 't':
+                [[fallthrough]];
+            case 'f':
+                input.PutBack();
+                handler.Bool(LoadBool(input).AsBool());
+                break;
+            case 'n':
+                input.PutBack();
+                LoadNull(input);
+                handler.Null();
+                break;
+            default:
+                input.PutBack();
+                if (const Node number = LoadNumber(input); number.IsInt()) {
+                    handler.Int(number.AsInt());
+                }
+                else {
+                    handler.Double(number.AsDouble());
+                }
+                break;
+            }
+        }
+
+        std::string ReadAll(std::istream& input) {
+            // Поток вычитывается целиком большими блоками, дальше разбор идёт по буферу
+            std::string buffer;
+            constexpr size_t chunk_size = 1 << 16;
+            while (input) {
+                const size_t size = buffer.size();
+                buffer.resize(size + chunk_size);
+                input.read(buffer.data() + size, chunk_size);
+                buffer.resize(size + static_cast<size_t>(input.gcount()));
+            }
+            return buffer;
+        }
+
         struct PrintContext {
             std::ostream& out;
             int indent_step = 4;
@@ -256,29 +442,16 @@ namespace json {
             ctx.out << value;
         }
 
+        // Строка экранируется порциями через буфер на стеке и выводится в поток целыми порциями
         void PrintString(const std::string& value, std::ostream& out) {
+            constexpr size_t chunk_size = 4096;
+            char escaped[2 * chunk_size];
+
             out.put('"');
-            for (const char c : value) {
-                switch (c) {
-                case '\r':
-                    out << "\\r"sv;
-                    break;
-                case '\n':
-                    out << "\\n"sv;
-                    break;
-                case '\t':
-                    out << "\\t"sv;
-                    break;
-                case '"':
-                    // Символы " и \ выводятся как \" или \\, соответственно
-                    [[fallthrough]];
-                case '\\':
-                    out.put('\\');
-                    [[fallthrough]];
-                default:
-                    out.put(c);
-                    break;
-                }
+            for (size_t pos = 0; pos < value.size(); pos += chunk_size) {
+                const std::string_view chunk = std::string_view(value).substr(pos, chunk_size);
+                const char* escaped_end = EscapeChars(chunk, escaped);
+                out.write(escaped, escaped_end - escaped);
             }
             out.put('"');
         }
@@ -356,8 +529,26 @@ namespace json {
 
     }  // namespace
 
+    Document Load(std::string_view input) {
+        const StructuralIndex index(input);
+        Input in{ input.data(), input.data(), input.data() + input.size(), index.begin(), index.end() };
+        return Document{ LoadNode(in) };
+    }
+
     Document Load(std::istream& input) {
-        return Document{ LoadNode(input) };
+        return Load(std::string_view(ReadAll(input)));
+    }
+
+    void Parse(std::string_view input, SaxHandler& handler) {
+        const StructuralIndex index(input);
+        Input in{ input.data(), input.data(), input.data() + input.size(), index.begin(), index.end() };
+        std::string buffer;
+        ParseNode(in, handler, buffer);
+    }
+
+    void Parse(std::istream& input, SaxHandler& handler) {
+        const std::string buffer = ReadAll(input);
+        Parse(std::string_view(buffer), handler);
     }
 
     void Print(const Document& doc, std::ostream& output) {
@@ -3,6 +3,7 @@
 #include <iostream>
 #include <map>
 #include <string>
+#include <string_view>
 #include <variant>
 #include <vector>
 
@@ -135,8 +136,37 @@ namespace json {
         return !(lhs == rhs);
     }
 
+    // Разбирает JSON, целиком находящийся в непрерывном буфере
+    Document Load(std::string_view input);
+
+    // Вычитывает поток до конца и разбирает его содержимое как буфер
     Document Load(std::istream& input);
 
     void Print(const Document& doc, std::ostream& output);
 
+    // Получатель событий потокового разбора. Строки передаются представлениями,
+    // которые действительны только до возврата из обработчика.
+    // В отличие от Load, повторяющиеся ключи словаря разбор не проверяет
+    class SaxHandler {
+    public:
+        virtual ~SaxHandler() = default;
+
+        virtual void StartDict() = 0;
+        virtual void Key(std::string_view key) = 0;
+        virtual void EndDict() = 0;
+
+        virtual void StartArray() = 0;
+        virtual void EndArray() = 0;
+
+        virtual void String(std::string_view value) = 0;
+        virtual void Int(int value) = 0;
+        virtual void Double(double value) = 0;
+        virtual void Bool(bool value) = 0;
+        virtual void Null() = 0;
+    };
+
+    // Разбирает JSON без построения дерева, сообщая о каждом элементе обработчику
+    void Parse(std::string_view input, SaxHandler& handler);
+    void Parse(std::istream& input, SaxHandler& handler);
+
 }  // namespace json
\ No newline at end of file
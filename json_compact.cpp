@@ -0,0 +1,259 @@
+#include "json_compact.h"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace json {
+
+    using namespace std::literals;
+
+    namespace {
+        // До такого размера линейный просмотр словаря быстрее двоичного поиска
+        constexpr size_t linear_lookup_limit = 8;
+
+        bool KeyLess(const CompactMember& lhs, const CompactMember& rhs) {
+            return lhs.key < rhs.key;
+        }
+    }
+
+    // ---------- CompactArray ------------------
+
+    const CompactNode& CompactArray::operator[](size_t index) const {
+        return items_[index];
+    }
+
+    // ---------- CompactDict ------------------
+
+    const CompactMember* CompactDict::find(std::string_view key) const {
+        if (size_ <= linear_lookup_limit) {
+            return std::find_if(begin(), end(), [key](const CompactMember& member) {
+                return member.key == key;
+            });
+        }
+
+        const CompactMember* it = std::lower_bound(begin(), end(), key,
+            [](const CompactMember& member, std::string_view key) {
+                return member.key < key;
+            });
+        return it != end() && it->key == key ? it : end();
+    }
+
+    size_t CompactDict::count(std::string_view key) const {
+        return find(key) != end() ? 1 : 0;
+    }
+
+    const CompactNode& CompactDict::at(std::string_view key) const {
+        const CompactMember* it = find(key);
+        if (it == end()) {
+            throw std::out_of_range("Key '"s + std::string(key) + "' not found"s);
+        }
+        return it->value;
+    }
+
+    // ---------- CompactNode ------------------
+
+    CompactNode CompactNode::MakeBool(bool value) {
+        CompactNode node;
+        node.type_ = Type::Bool;
+        node.bool_ = value;
+        return node;
+    }
+
+    CompactNode CompactNode::MakeInt(int value) {
+        CompactNode node;
+        node.type_ = Type::Int;
+        node.int_ = value;
+        return node;
+    }
+
+    CompactNode CompactNode::MakeDouble(double value) {
+        CompactNode node;
+        node.type_ = Type::Double;
+        node.double_ = value;
+        return node;
+    }
+
+    CompactNode CompactNode::MakeString(std::string_view value) {
+        CompactNode node;
+        node.type_ = Type::String;
+        node.size_ = static_cast<uint32_t>(value.size());
+        node.chars_ = value.data();
+        return node;
+    }
+
+    CompactNode CompactNode::MakeArray(const CompactNode* items, size_t size) {
+        CompactNode node;
+        node.type_ = Type::Array;
+        node.size_ = static_cast<uint32_t>(size);
+        node.items_ = items;
+        return node;
+    }
+
+    CompactNode CompactNode::MakeDict(const CompactMember* members, size_t size) {
+        CompactNode node;
+        node.type_ = Type::Dict;
+        node.size_ = static_cast<uint32_t>(size);
+        node.members_ = members;
+        return node;
+    }
+
+    int CompactNode::AsInt() const {
+        if (!IsInt()) {
+            throw std::logic_error("Not an int"s);
+        }
+        return int_;
+    }
+
+    double CompactNode::AsDouble() const {
+        if (!IsDouble()) {
+            throw std::logic_error("Not a double"s);
+        }
+        return IsPureDouble() ? double_ : int_;
+    }
+
+    bool CompactNode::AsBool() const {
+        if (!IsBool()) {
+            throw std::logic_error("Not a bool"s);
+        }
+        return bool_;
+    }
+
+    std::string_view CompactNode::AsString() const {
+        if (!IsString()) {
+            throw std::logic_error("Not a string"s);
+        }
+        return { chars_, size_ };
+    }
+
+    CompactArray CompactNode::AsArray() const {
+        if (!IsArray()) {
+            throw std::logic_error("Not an array"s);
+        }
+        return { items_, size_ };
+    }
+
+    CompactDict CompactNode::AsDict() const {
+        if (!IsDict()) {
+            throw std::logic_error("Not a dict"s);
+        }
+        return { members_, size_ };
+    }
+
+    // ---------- CompactDocument ------------------
+
+    CompactDocument::CompactDocument() :
+        arena_(std::make_unique<std::pmr::monotonic_buffer_resource>()) {
+    }
+
+    // ---------- CompactDocumentHandler ------------------
+
+    CompactDocumentHandler::CompactDocumentHandler(std::string_view input) :
+        input_(input) {
+    }
+
+    void CompactDocumentHandler::StartDict() {
+        stack_.push_back({ true, members_.size(), {} });
+    }
+
+    void CompactDocumentHandler::Key(std::string_view key) {
+        stack_.back().key = Store(key);
+    }
+
+    // Пары сортируются по ключу при закрытии словаря, после чего повторы оказываются рядом
+    void CompactDocumentHandler::EndDict() {
+        const auto first = members_.begin() + stack_.back().start;
+        std::sort(first, members_.end(), KeyLess);
+
+        const auto duplicate = std::adjacent_find(first, members_.end(),
+            [](const CompactMember& lhs, const CompactMember& rhs) {
+                return lhs.key == rhs.key;
+            });
+        if (duplicate != members_.end()) {
+            throw ParsingError("Duplicate key '"s + std::string(duplicate->key) + "' have been found");
+        }
+
+        const size_t size = members_.end() - first;
+        auto* members = static_cast<CompactMember*>(
+            document_.arena_->allocate(size * sizeof(CompactMember), alignof(CompactMember)));
+        std::uninitialized_copy(first, members_.end(), members);
+
+        members_.erase(first, members_.end());
+        stack_.pop_back();
+        AddValue(CompactNode::MakeDict(members, size));
+    }
+
+    void CompactDocumentHandler::StartArray() {
+        stack_.push_back({ false, values_.size(), {} });
+    }
+
+    void CompactDocumentHandler::EndArray() {
+        const auto first = values_.begin() + stack_.back().start;
+        const size_t size = values_.end() - first;
+        auto* items = static_cast<CompactNode*>(
+            document_.arena_->allocate(size * sizeof(CompactNode), alignof(CompactNode)));
+        std::uninitialized_copy(first, values_.end(), items);
+
+        values_.erase(first, values_.end());
+        stack_.pop_back();
+        AddValue(CompactNode::MakeArray(items, size));
+    }
+
+    void CompactDocumentHandler::String(std::string_view value) {
+        AddValue(CompactNode::MakeString(Store(value)));
+    }
+
+    void CompactDocumentHandler::Int(int value) {
+        AddValue(CompactNode::MakeInt(value));
+    }
+
+    void CompactDocumentHandler::Double(double value) {
+        AddValue(CompactNode::MakeDouble(value));
+    }
+
+    void CompactDocumentHandler::Bool(bool value) {
+        AddValue(CompactNode::MakeBool(value));
+    }
+
+    void CompactDocumentHandler::Null() {
+        AddValue(CompactNode{});
+    }
+
+    bool CompactDocumentHandler::IsComplete() const {
+        return complete_;
+    }
+
+    CompactDocument CompactDocumentHandler::Build() {
+        complete_ = false;
+        return std::exchange(document_, CompactDocument{});
+    }
+
+    void CompactDocumentHandler::AddValue(CompactNode value) {
+        if (stack_.empty()) {
+            document_.root_ = value;
+            complete_ = true;
+        }
+        else if (stack_.back().is_dict) {
+            members_.push_back({ stack_.back().key, value });
+        }
+        else {
+            values_.push_back(value);
+        }
+    }
+
+    // Строки, лежащие во входном буфере, не копируются; std::less упорядочивает и несвязанные указатели
+    std::string_view CompactDocumentHandler::Store(std::string_view value) {
+        const std::less<const char*> less;
+        if (!less(value.data(), input_.data()) && !less(input_.data() + input_.size(), value.data() + value.size())) {
+            return value;
+        }
+
+        char* data = static_cast<char*>(document_.arena_->allocate(value.size(), 1));
+        std::memcpy(data, value.data(), value.size());
+        return { data, value.size() };
+    }
+
+}  // namespace json
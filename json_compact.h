@@ -0,0 +1,232 @@
+#pragma once
+
+#include "json.h"
+
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <string_view>
+#include <vector>
+
+namespace json {
+
+    class CompactArray;
+    class CompactDict;
+    struct CompactMember;
+
+    // Узел компактного документа занимает 16 байт: тег типа, длина и значение либо указатель.
+    // Строки и содержимое контейнеров принадлежат документу и не копируются вместе с узлом.
+    // Методы доступа повторяют Node, но строки возвращаются представлениями
+    class CompactNode {
+    public:
+        enum class Type : uint8_t {
+            Null,
+            Bool,
+            Int,
+            Double,
+            String,
+            Array,
+            Dict
+        };
+
+        CompactNode() :
+            chars_(nullptr) {
+        }
+
+        static CompactNode MakeBool(bool value);
+        static CompactNode MakeInt(int value);
+        static CompactNode MakeDouble(double value);
+        static CompactNode MakeString(std::string_view value);
+        static CompactNode MakeArray(const CompactNode* items, size_t size);
+        static CompactNode MakeDict(const CompactMember* members, size_t size);
+
+        Type GetType() const {
+            return type_;
+        }
+
+        bool IsInt() const {
+            return type_ == Type::Int;
+        }
+        int AsInt() const;
+
+        bool IsPureDouble() const {
+            return type_ == Type::Double;
+        }
+        bool IsDouble() const {
+            return IsInt() || IsPureDouble();
+        }
+        double AsDouble() const;
+
+        bool IsBool() const {
+            return type_ == Type::Bool;
+        }
+        bool AsBool() const;
+
+        bool IsNull() const {
+            return type_ == Type::Null;
+        }
+
+        bool IsString() const {
+            return type_ == Type::String;
+        }
+        std::string_view AsString() const;
+
+        bool IsArray() const {
+            return type_ == Type::Array;
+        }
+        CompactArray AsArray() const;
+
+        bool IsDict() const {
+            return type_ == Type::Dict;
+        }
+        CompactDict AsDict() const;
+
+    private:
+        Type type_ = Type::Null;
+        // Длина строки либо число элементов контейнера
+        uint32_t size_ = 0;
+        union {
+            bool bool_;
+            int int_;
+            double double_;
+            const char* chars_;
+            const CompactNode* items_;
+            const CompactMember* members_;
+        };
+    };
+
+    struct CompactMember {
+        std::string_view key;
+        CompactNode value;
+    };
+
+    static_assert(sizeof(CompactNode) == 16);
+
+    // Массив компактного документа: представление элементов, лежащих подряд в арене документа
+    class CompactArray {
+    public:
+        CompactArray() = default;
+        CompactArray(const CompactNode* items, size_t size) :
+            items_(items), size_(size) {
+        }
+
+        const CompactNode* begin() const {
+            return items_;
+        }
+        const CompactNode* end() const {
+            return items_ + size_;
+        }
+
+        size_t size() const {
+            return size_;
+        }
+        bool empty() const {
+            return size_ == 0;
+        }
+
+        const CompactNode& operator[](size_t index) const;
+
+    private:
+        const CompactNode* items_ = nullptr;
+        size_t size_ = 0;
+    };
+
+    // Словарь компактного документа: плоский массив пар, упорядоченный по ключу, как и Dict.
+    // Небольшие словари просматриваются линейно, в остальных ключ ищется двоичным поиском
+    class CompactDict {
+    public:
+        CompactDict() = default;
+        CompactDict(const CompactMember* members, size_t size) :
+            members_(members), size_(size) {
+        }
+
+        const CompactMember* begin() const {
+            return members_;
+        }
+        const CompactMember* end() const {
+            return members_ + size_;
+        }
+
+        size_t size() const {
+            return size_;
+        }
+        bool empty() const {
+            return size_ == 0;
+        }
+
+        // Возвращает end(), если ключа нет
+        const CompactMember* find(std::string_view key) const;
+        size_t count(std::string_view key) const;
+
+        // Как и std::map::at, при отсутствии ключа выбрасывает std::out_of_range
+        const CompactNode& at(std::string_view key) const;
+
+    private:
+        const CompactMember* members_ = nullptr;
+        size_t size_ = 0;
+    };
+
+    // Документ владеет ареной, из которой выделены его контейнеры и скопированные строки.
+    // Строки без escape-последовательностей, собранные CompactDocumentHandler, ссылаются прямо на вход,
+    // поэтому входной буфер должен жить не меньше документа
+    class CompactDocument {
+    public:
+        CompactDocument();
+
+        const CompactNode& GetRoot() const {
+            return root_;
+        }
+
+    private:
+        friend class CompactDocumentHandler;
+
+        std::unique_ptr<std::pmr::monotonic_buffer_resource> arena_;
+        CompactNode root_;
+    };
+
+    // Собирает компактный документ из событий разбора. Строки, лежащие внутри input,
+    // сохраняются представлениями, остальные копируются в арену документа
+    class CompactDocumentHandler final : public SaxHandler {
+    public:
+        explicit CompactDocumentHandler(std::string_view input = {});
+
+        void StartDict() override;
+        void Key(std::string_view key) override;
+        void EndDict() override;
+
+        void StartArray() override;
+        void EndArray() override;
+
+        void String(std::string_view value) override;
+        void Int(int value) override;
+        void Double(double value) override;
+        void Bool(bool value) override;
+        void Null() override;
+
+        // Значение верхнего уровня полностью получено
+        bool IsComplete() const;
+
+        // Отдаёт документ и начинает сборку следующего
+        CompactDocument Build();
+
+    private:
+        // Элементы открытого контейнера лежат в values_ или members_ начиная с позиции start
+        struct Frame {
+            bool is_dict = false;
+            size_t start = 0;
+            std::string_view key;
+        };
+
+        void AddValue(CompactNode value);
+        std::string_view Store(std::string_view value);
+
+        std::string_view input_;
+        CompactDocument document_;
+        bool complete_ = false;
+
+        std::vector<Frame> stack_;
+        std::vector<CompactNode> values_;
+        std::vector<CompactMember> members_;
+    };
+
+}  // namespace json
@@ -1,291 +1,819 @@
 #include "json_reader.h"
 
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <memory_resource>
+#include <optional>
 #include <set>
-#include "json_builder.h"
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+#include "json_writer.h"
 
 namespace transport {
 	namespace reader {
 
 		using namespace std::literals;
 
-		void JsonReader::ProcessJSON(TransportCatalogue& tc, renderer::MapRenderer& mr,
-			std::istream& input, std::ostream& output) {
+		namespace {
 
-			const json::Dict json_dict = json::Load(input).GetRoot().AsDict();
+			// Принимает события массива base_requests и сразу передаёт остановки в справочник.
+			// Расстояния и маршруты ссылаются на остановки по имени и могут опережать их описание,
+			// поэтому они откладываются до конца массива и добавляются после всех остановок:
+			// сначала расстояния, затем маршруты, каждые в порядке следования в запросе
+			class BaseRequestsHandler final : public json::SaxHandler {
+			public:
+				explicit BaseRequestsHandler(CatalogueBuilder& builder) :
+					builder_(builder) {
+				}
 
-			const auto base_requests_it = json_dict.find("base_requests"s);
+				void StartDict() override {
+					if (depth_ == 1) {
+						request_.Clear();
+					}
+					else if (depth_ == 2) {
+						nested_ = field_ == "road_distances"sv ? Nested::Distances : Nested::Other;
+						if (nested_ == Nested::Distances) {
+							request_.has_distances = true;
+							request_.distances.clear();
+						}
+					}
+					else if (depth_ == 0) {
+						CheckInRequest();
+					}
+					++depth_;
+				}
 
-			if (base_requests_it != json_dict.end()) {
-				FillCatalogue(tc,base_requests_it->second.AsArray());
-			}
+				void Key(std::string_view key) override {
+					if (depth_ == 2) {
+						field_ = key;
+					}
+					else if (depth_ == 3 && nested_ == Nested::Distances) {
+						distance_to_ = Intern(key);
+					}
+				}
 
+				void EndDict() override {
+					if (--depth_ == 1) {
+						AddRequest();
+					}
+				}
 
-			const auto renderer_settings_it = json_dict.find("render_settings"s);
-			if (renderer_settings_it != json_dict.cend())
-			{
-				LoadRendererSettings(mr, renderer_settings_it->second.AsDict());
-			}
+				void StartArray() override {
+					if (depth_ == 1) {
+						CheckInRequest();
+					}
+					if (depth_ == 2) {
+						nested_ = field_ == "stops"sv ? Nested::Stops : Nested::Other;
+						request_.has_stops = request_.has_stops || nested_ == Nested::Stops;
+						if (nested_ == Nested::Stops) {
+							request_.stops.clear();
+						}
+					}
+					++depth_;
+				}
 
+				void EndArray() override {
+					--depth_;
+				}
 
-			const auto router_settings_it = json_dict.find("routing_settings"s);
+				void String(std::string_view value) override {
+					if (depth_ == 2) {
+						if (field_ == "type"sv) {
+							request_.type = value;
+						}
+						else if (field_ == "name"sv) {
+							request_.name = value;
+						}
+					}
+					else if (depth_ == 3 && nested_ == Nested::Stops) {
+						request_.stops.push_back(Intern(value));
+					}
+					else {
+						CheckInRequest();
+					}
+				}
 
-			const TransportRouter& tr = { {LoadRoutingSettings(router_settings_it->second.AsDict())}, tc };
+				void Int(int value) override {
+					if (depth_ == 3 && nested_ == Nested::Distances) {
+						request_.distances.push_back({ distance_to_, value });
+						return;
+					}
+					Number(value);
+				}
 
-			transport::RequestHandler rh(tc, mr, tr);
+				void Double(double value) override {
+					if (depth_ == 3 && nested_ == Nested::Distances) {
+						throw std::logic_error("Not an int"s);
+					}
+					Number(value);
+				}
 
-			const auto stat_requests_it = json_dict.find("stat_requests"s);
+				void Bool(bool value) override {
+					if (depth_ == 2 && field_ == "is_roundtrip"sv) {
+						request_.is_roundtrip = value;
+					}
+					else {
+						CheckInRequest();
+					}
+				}
 
-			if (stat_requests_it != json_dict.end()) {
-				ProcessQueries(output, rh, stat_requests_it->second.AsArray());
-			}
+				void Null() override {
+					CheckInRequest();
+				}
 
-		}
+				// Добавляет отложенные расстояния и маршруты
+				void Finish() {
+					for (const PendingDistance& distance : distances_) {
+						builder_.SetDistance(distance.from, builder_.GetStop(distance.to), distance.distance);
+					}
 
-		void JsonReader::FillCatalogue(TransportCatalogue& tc, const json::Array& json_arr) {
+					for (const PendingBus& pending : buses_) {
+						domain::Bus bus;
+						bus.name_ = pending.name;
+						bus.is_circular_ = pending.is_roundtrip;
+
+						for (size_t i = pending.stops_begin; i < pending.stops_end; ++i) {
+							if (const domain::Stop* stop = builder_.GetStop(bus_stops_[i])) {
+								bus.stops_.push_back(stop);
+							}
+						}
+						builder_.AddBus(std::move(bus));
+					}
 
-			json::Array bus_arr;
+					distances_.clear();
+					buses_.clear();
+					bus_stops_.clear();
+				}
 
-			for (const auto& item : json_arr) {
+			private:
+				enum class Nested {
+					Distances,
+					Stops,
+					Other
+				};
 
-				const auto request_type = item.AsDict().find("type"s);
+				struct Request {
+					std::string type;
+					std::optional<std::string> name;
+					std::optional<double> latitude;
+					std::optional<double> longitude;
+					std::optional<bool> is_roundtrip;
+					std::vector<std::pair<std::string_view, int>> distances;
+					std::vector<std::string_view> stops;
+					bool has_distances = false;
+					bool has_stops = false;
+
+					// Сбрасывает поля, сохраняя память векторов для следующего запроса
+					void Clear() {
+						type.clear();
+						name.reset();
+						latitude.reset();
+						longitude.reset();
+						is_roundtrip.reset();
+						distances.clear();
+						stops.clear();
+						has_distances = false;
+						has_stops = false;
+					}
+				};
+
+				struct PendingDistance {
+					const domain::Stop* from;
+					std::string_view to;
+					size_t distance;
+				};
 
-				if (request_type != item.AsDict().end() and request_type->second.AsString() == "Stop"s) {
-					AddStopData(tc, item.AsDict());
+				// Остановки маршрута лежат в bus_stops_ на отрезке [stops_begin, stops_end)
+				struct PendingBus {
+					std::string_view name;
+					bool is_roundtrip;
+					size_t stops_begin;
+					size_t stops_end;
+				};
+
+				void Number(double value) {
+					if (depth_ == 2) {
+						if (field_ == "latitude"sv) {
+							request_.latitude = value;
+						}
+						else if (field_ == "longitude"sv) {
+							request_.longitude = value;
+						}
+					}
+					else {
+						CheckInRequest();
+					}
 				}
 
-				if (request_type->second.AsString() == "Bus"s) {
-					bus_arr.push_back(item);
+				// Значения допустимы только внутри словаря запроса, как и при обращении к DOM через AsArray и AsDict
+				void CheckInRequest() const {
+					if (depth_ == 0) {
+						throw std::logic_error("Not an array"s);
+					}
+					if (depth_ == 1) {
+						throw std::logic_error("Not a dict"s);
+					}
 				}
-			}
 
-			for (const auto& item : json_arr) {
+				void AddRequest() {
+					if (request_.type == "Stop"sv) {
+						if (!request_.name || !request_.latitude || !request_.longitude || !request_.has_distances) {
+							throw std::out_of_range("Stop request lacks name, coordinates or road_distances"s);
+						}
+						builder_.AddStop(domain::Stop{ *request_.name, { *request_.latitude, *request_.longitude } });
+
+						const domain::Stop* from = builder_.GetStop(*request_.name);
+						for (const auto& [to, distance] : request_.distances) {
+							distances_.push_back({ from, to, static_cast<size_t>(distance) });
+						}
+					}
+					else if (request_.type == "Bus"sv) {
+						if (!request_.name || !request_.is_roundtrip || !request_.has_stops) {
+							throw std::out_of_range("Bus request lacks name, is_roundtrip or stops"s);
+						}
+						const size_t stops_begin = bus_stops_.size();
+						bus_stops_.insert(bus_stops_.end(), request_.stops.begin(), request_.stops.end());
+						buses_.push_back({ Intern(*request_.name), *request_.is_roundtrip, stops_begin, bus_stops_.size() });
+					}
+				}
+
+				// Имена из отложенных ссылок копируются в арену: строки событий живут только до возврата из обработчика
+				std::string_view Intern(std::string_view name) {
+					char* data = static_cast<char*>(names_.allocate(name.size(), 1));
+					std::copy(name.begin(), name.end(), data);
+					return { data, name.size() };
+				}
 
-				const auto request_type = item.AsDict().find("type"s);
+				CatalogueBuilder& builder_;
+
+				int depth_ = 0;
+				std::string field_;
+				Nested nested_ = Nested::Other;
+				std::string_view distance_to_;
+				Request request_;
+
+				std::pmr::monotonic_buffer_resource names_;
+				std::vector<PendingDistance> distances_;
+				std::vector<PendingBus> buses_;
+				std::vector<std::string_view> bus_stops_;
+			};
 
-				if (request_type != item.AsDict().end() and request_type->second.AsString() == "Stop"s) {
-					AddStopDistance(tc, item.AsDict());
+			// Принимает события массива stat_requests. Каждый запрос собирается в DOM отдельно
+			// и выполняется, как только его описание закончилось, так что в памяти находится только он
+			class StatRequestsHandler final : public json::SaxHandler {
+			public:
+				using StartCallback = std::function<void()>;
+				using QueryCallback = std::function<void(const json::CompactNode& query)>;
+
+				StatRequestsHandler(StartCallback on_start, QueryCallback on_query) :
+					on_start_(std::move(on_start)), on_query_(std::move(on_query)) {
 				}
 
-			}
+				void StartDict() override {
+					Forward([](json::SaxHandler& handler) { handler.StartDict(); });
+				}
 
-			for (const auto& item : bus_arr) {
+				void Key(std::string_view key) override {
+					Forward([key](json::SaxHandler& handler) { handler.Key(key); });
+				}
 
-				const auto request_type = item.AsDict().find("type"s);
+				void EndDict() override {
+					Forward([](json::SaxHandler& handler) { handler.EndDict(); });
+				}
 
-				if (request_type != item.AsDict().end()) {
-					AddBusData(tc, item.AsDict());
+				void StartArray() override {
+					if (!in_array_) {
+						in_array_ = true;
+						on_start_();
+						return;
+					}
+					Forward([](json::SaxHandler& handler) { handler.StartArray(); });
 				}
 
-			}
+				void EndArray() override {
+					if (!in_element_) {
+						in_array_ = false;
+						return;
+					}
+					Forward([](json::SaxHandler& handler) { handler.EndArray(); });
+				}
 
-		}
+				void String(std::string_view value) override {
+					Forward([value](json::SaxHandler& handler) { handler.String(value); });
+				}
 
-		void JsonReader::AddStopData(TransportCatalogue& tc, const json::Dict& json_stop) {
-			tc.AddStop(domain::Stop{ json_stop.at("name"s).AsString(),
-				{json_stop.at("latitude"s).AsDouble(),
-				json_stop.at("longitude"s).AsDouble()} });
-		}
+				void Int(int value) override {
+					Forward([value](json::SaxHandler& handler) { handler.Int(value); });
+				}
 
-		void JsonReader::AddStopDistance(TransportCatalogue& tc, const json::Dict& json_stop) {
+				void Double(double value) override {
+					Forward([value](json::SaxHandler& handler) { handler.Double(value); });
+				}
 
-			const domain::Stop* from_ptr = tc.GetStop(json_stop.at("name"s).AsString());
+				void Bool(bool value) override {
+					Forward([value](json::SaxHandler& handler) { handler.Bool(value); });
+				}
 
-			if (from_ptr) {
-				const json::Dict stops = json_stop.at("road_distances"s).AsDict();
-				for (const auto& [stop, distance] : stops) {
-					tc.SetDistance(const_cast<domain::Stop*>(from_ptr),
-						const_cast<domain::Stop*>(tc.GetStop(stop)), static_cast<size_t>(distance.AsInt()));
+				void Null() override {
+					Forward([](json::SaxHandler& handler) { handler.Null(); });
 				}
-			}
-		}
 
-		void JsonReader::AddBusData(TransportCatalogue& tc, const json::Dict& json_bus) {
-			domain::Bus bus;
-			bus.name_ = json_bus.at("name"s).AsString();
-			bus.is_circular_ = json_bus.at("is_roundtrip"s).AsBool();
+			private:
+
+				// Передаёт событие сборщику текущего элемента и выполняет элемент, когда он собран целиком
+				template <typename Event>
+				void Forward(Event event) {
+					// Значение раздела должно быть массивом, как и при обращении к DOM через AsArray
+					if (!in_array_) {
+						throw std::logic_error("Not an array"s);
+					}
+
+					event(element_);
+					if (!element_.IsComplete()) {
+						in_element_ = true;
+						return;
+					}
 
-			for (auto& item : json_bus.at("stops"s).AsArray()) {
-				domain::Stop* tmp_ptr = const_cast<domain::Stop*>(tc.GetStop(item.AsString()));
-				if (tmp_ptr) {
-					bus.stops_.push_back(tmp_ptr);
+					in_element_ = false;
+					on_query_(element_.Build().GetRoot());
 				}
-			}
-			tc.AddBus(std::move(bus));
-		}
 
-		void JsonReader::ProcessQueries(std::ostream& out, RequestHandler& rh, const json::Array& json_arr) {
+				StartCallback on_start_;
+				QueryCallback on_query_;
 
-			json::Array completed_queries;
+				bool in_array_ = false;
+				bool in_element_ = false;
+				json::CompactDocumentHandler element_;
+			};
 
+			// Разбирает корневой словарь запроса. Массив base_requests передаётся в справочник потоково.
+			// Запросы stat_requests выполняются по мере разбора, если до них уже прочитаны все разделы,
+			// от которых зависят ответы; иначе они, как и остальные разделы, собираются в DOM
+			class RequestsHandler final : public json::SaxHandler {
+			public:
+				// Вызывается перед первым потоковым запросом, когда прочитаны все разделы до stat_requests
+				using PrepareCallback = std::function<void(const RequestsHandler& handler)>;
+
+				RequestsHandler(CatalogueBuilder& builder, PrepareCallback on_prepare,
+					StatRequestsHandler::QueryCallback on_query) :
+					base_requests_(builder),
+					stat_requests_([this] { on_prepare_(*this); }, std::move(on_query)),
+					on_prepare_(std::move(on_prepare)) {
+				}
 
-			for (const auto& query : json_arr) {
-				const auto request_type = query.AsDict().find("type"s);
-				if (request_type != query.AsDict().cend()) {
+				bool HasBaseRequests() const {
+					return has_base_requests_;
+				}
+
+				// Возвращает значение раздела, собранного в DOM, или nullptr, если раздела не было
+				const json::CompactNode* GetSection(std::string_view name) const {
+					const auto it = sections_.find(name);
+					return it != sections_.end() ? &it->second.GetRoot() : nullptr;
+				}
+
+				bool HasStreamedStatRequests() const {
+					return has_streamed_stat_requests_;
+				}
 
-					if (request_type->second.AsString() == "Stop"s) {
-						completed_queries.emplace_back(ProcessStopQuery(rh, query.AsDict()));
+				void StartDict() override {
+					if (!target_ && !in_root_) {
+						in_root_ = true;
+						return;
 					}
+					Forward([](json::SaxHandler& handler) { handler.StartDict(); }, 1);
+				}
 
-					else if (request_type->second.AsString() == "Bus"s) {
-						completed_queries.emplace_back(ProcessBusQuery(rh, query.AsDict()));
+				void Key(std::string_view key) override {
+					if (target_) {
+						target_->Key(key);
+						return;
 					}
 
-					else if (request_type->second.AsString() == "Map"s) {
-						completed_queries.emplace_back(ProcessMapQuery(rh, query.AsDict()));
+					// Повторяющиеся разделы отвергаются, как и повторяющиеся ключи при разборе в DOM
+					if (!seen_sections_.emplace(key).second) {
+						throw json::ParsingError("Duplicate key '"s + std::string(key) + "' have been found");
 					}
 
-					else if (request_type->second.AsString() == "Route"s)
-					{
-						completed_queries.emplace_back(ProcessRoutingQuery(rh, query.AsDict()));
+					section_ = key;
+					if (key == "base_requests"sv) {
+						target_ = &base_requests_;
+					}
+					else if (key == "stat_requests"sv && has_base_requests_
+						&& GetSection("render_settings"sv) && GetSection("routing_settings"sv)) {
+						target_ = &stat_requests_;
+					}
+					else {
+						target_ = &document_;
+					}
+				}
+
+				void EndDict() override {
+					if (!target_) {
+						in_root_ = false;
+						return;
+					}
+					Forward([](json::SaxHandler& handler) { handler.EndDict(); }, -1);
+				}
+
+				void StartArray() override {
+					Forward([](json::SaxHandler& handler) { handler.StartArray(); }, 1);
+				}
+
+				void EndArray() override {
+					Forward([](json::SaxHandler& handler) { handler.EndArray(); }, -1);
+				}
+
+				void String(std::string_view value) override {
+					Forward([value](json::SaxHandler& handler) { handler.String(value); }, 0);
+				}
+
+				void Int(int value) override {
+					Forward([value](json::SaxHandler& handler) { handler.Int(value); }, 0);
+				}
+
+				void Double(double value) override {
+					Forward([value](json::SaxHandler& handler) { handler.Double(value); }, 0);
+				}
+
+				void Bool(bool value) override {
+					Forward([value](json::SaxHandler& handler) { handler.Bool(value); }, 0);
+				}
+
+				void Null() override {
+					Forward([](json::SaxHandler& handler) { handler.Null(); }, 0);
+				}
+
+			private:
+
+				// Передаёт событие обработчику текущего раздела; по завершении значения раздела обработчик сбрасывается
+				template <typename Event>
+				void Forward(Event event, int depth_change) {
+					// Вне разделов допустимы только открытие и закрытие корневого словаря
+					if (!target_) {
+						throw std::logic_error("Not a dict"s);
+					}
+
+					event(*target_);
+					depth_ += depth_change;
+					if (depth_ > 0) {
+						return;
 					}
 
+					if (target_ == &base_requests_) {
+						base_requests_.Finish();
+						has_base_requests_ = true;
+					}
+					else if (target_ == &stat_requests_) {
+						has_streamed_stat_requests_ = true;
+					}
+					else {
+						sections_.insert_or_assign(section_, document_.Build());
+					}
+					target_ = nullptr;
 				}
-				//c++;
+
+				BaseRequestsHandler base_requests_;
+				StatRequestsHandler stat_requests_;
+				PrepareCallback on_prepare_;
+				json::CompactDocumentHandler document_;
+				json::SaxHandler* target_ = nullptr;
+
+				bool in_root_ = false;
+				int depth_ = 0;
+				std::string section_;
+
+				bool has_base_requests_ = false;
+				bool has_streamed_stat_requests_ = false;
+				std::set<std::string, std::less<>> seen_sections_;
+				std::map<std::string, json::CompactDocument, std::less<>> sections_;
+			};
+
+		}
+
+		void JsonReader::ProcessJSON(CatalogueBuilder& builder, CatalogueStore& store, renderer::MapRenderer& mr,
+			std::istream& input, std::ostream& output) {
+
+			// Массив base_requests передаётся в справочник по мере разбора, без построения DOM,
+			// а ответы на stat_requests по возможности выводятся сразу после выполнения запроса
+			json::Writer responses(output);
+
+			auto apply_settings = [&](const RequestsHandler& sections) {
+				ApplySettings(builder, store, mr, sections.GetSection("render_settings"sv),
+					sections.GetSection("routing_settings"sv), sections.HasBaseRequests());
+			};
+
+			RequestsHandler handler(builder,
+				[&](const RequestsHandler& sections) {
+					apply_settings(sections);
+					responses.StartArray();
+				},
+				[&](const json::CompactNode& query) {
+					ProcessQuery(responses, store, mr, query);
+				});
+			json::Parse(input, handler);
+
+			if (handler.HasStreamedStatRequests()) {
+				responses.EndArray().Flush();
+				return;
 			}
-			json::Print(json::Document{ completed_queries }, out);
 
+			apply_settings(handler);
+
+			if (const json::CompactNode* stat_requests = handler.GetSection("stat_requests"sv)) {
+				ProcessQueries(output, store, mr, stat_requests->AsArray());
+			}
+
+		}
+
+		void JsonReader::ApplySettings(CatalogueBuilder& builder, CatalogueStore& store, renderer::MapRenderer& mr,
+			const json::CompactNode* render_settings, const json::CompactNode* routing_settings, bool has_base_requests) {
+
+			if (render_settings)
+			{
+				LoadRendererSettings(mr, render_settings->AsDict());
+			}
+
+
+			const auto current_version = store.Acquire();
+
+			if (has_base_requests || routing_settings || !current_version) {
+				const RouterSettings settings = routing_settings
+					? LoadRoutingSettings(routing_settings->AsDict())
+					: (current_version ? current_version->routing_settings : RouterSettings{});
+
+				store.Publish(builder.Freeze(), settings);
+			}
+		}
+
+		void JsonReader::ProcessQueries(std::ostream& out, const CatalogueStore& store, const renderer::MapRenderer& mr,
+			json::CompactArray json_arr) {
+
+			json::Writer responses(out);
+			responses.StartArray();
+
+			for (const auto& query : json_arr) {
+				ProcessQuery(responses, store, mr, query);
+			}
+			responses.EndArray().Flush();
 
 		}
 
-		const json::Node JsonReader::ProcessStopQuery(RequestHandler& rh, const json::Dict& json_stop) {
+		void JsonReader::ProcessQuery(json::Writer& writer, const CatalogueStore& store, const renderer::MapRenderer& mr,
+			const json::CompactNode& query) {
+
+			// Каждый запрос закрепляет актуальную версию справочника на время своей обработки
+			RequestHandler rh(store.Acquire(), mr);
+
+			const json::CompactDict json_query = query.AsDict();
+			const auto request_type = json_query.find("type"sv);
+			if (request_type != json_query.end()) {
+				const std::string_view type = request_type->value.AsString();
+
+				if (type == "Stop"sv) {
+					ProcessStopQuery(writer, rh, json_query);
+				}
+
+				else if (type == "Bus"sv) {
+					ProcessBusQuery(writer, rh, json_query);
+				}
+
+				else if (type == "Map"sv) {
+					ProcessMapQuery(writer, rh, json_query);
+				}
+
+				else if (type == "Route"sv)
+				{
+					ProcessRoutingQuery(writer, rh, json_query);
+				}
+
+				else if (type == "NearbyStops"sv)
+				{
+					ProcessNearbyStopsQuery(writer, rh, json_query);
+				}
+
+			}
+		}
+
+		// Ключи ответов записываются по возрастанию: в таком порядке их выводил json::Print из Dict
+
+		void JsonReader::ProcessStopQuery(json::Writer& writer, RequestHandler& rh, json::CompactDict json_stop) {
 			
 			const auto stop_query_ptr = rh.GetBusesByStop(
-				json_stop.at("name"s).AsString()
+				json_stop.at("name"sv).AsString()
 			);
 
 			if (stop_query_ptr == std::nullopt)
 			{
-				return json::Node{ json::Builder{}
-								.StartDict()
-									.Key("error_message"s).Value("not found"s)
-									.Key("request_id"s).Value(json_stop.at("id").AsInt())
-								.EndDict()
-					            .Build()
-				};
+				writer.StartDict()
+						.Key("error_message"sv).Value("not found"sv)
+						.Key("request_id"sv).Value(json_stop.at("id"sv).AsInt())
+					.EndDict();
 			}
 			else {
-				json::Array routes;
-				for (const auto& bus : *(stop_query_ptr.value()))
+				writer.StartDict()
+						.Key("buses"sv).StartArray();
+				for (const BusId bus_id : stop_query_ptr.value())
 				{
-					routes.push_back(bus->name_);
+					writer.Value(rh.GetBusById(bus_id).name_);
 				}
-
-				return json::Node{ json::Builder{}
-									.StartDict()
-										.Key("buses"s).Value(routes)
-										.Key("request_id"s).Value(json_stop.at("id").AsInt())
-									.EndDict()
-					                .Build()
-				};
+				writer.EndArray()
+						.Key("request_id"sv).Value(json_stop.at("id"sv).AsInt())
+					.EndDict();
 			}
 
 		}
 
-		const json::Node JsonReader::ProcessBusQuery(RequestHandler& rh, const json::Dict& json_bus) {
+		void JsonReader::ProcessBusQuery(json::Writer& writer, RequestHandler& rh, json::CompactDict json_bus) {
 
 			if (const auto bus_query_ptr = rh.GetBusStat(
-				json_bus.at("name"s).AsString())) {
-
-				return json::Node{ json::Builder{}
-								.StartDict()
-									.Key("curvature"s).Value(bus_query_ptr.value().curvature_)
-									.Key("request_id"s).Value(json_bus.at("id").AsInt())
-									.Key("route_length"s).Value(static_cast<int>(bus_query_ptr.value().route_length_))
-									.Key("stop_count"s).Value(static_cast<int>(bus_query_ptr.value().stops_count_))
-									.Key("unique_stop_count"s).Value(static_cast<int>(bus_query_ptr.value().unique_stops_count_))
-								.EndDict()
-					            .Build()
-				};
+				json_bus.at("name"sv).AsString())) {
+
+				writer.StartDict()
+						.Key("curvature"sv).Value(bus_query_ptr.value().curvature_)
+						.Key("request_id"sv).Value(json_bus.at("id"sv).AsInt())
+						.Key("route_length"sv).Value(static_cast<int>(bus_query_ptr.value().route_length_))
+						.Key("stop_count"sv).Value(static_cast<int>(bus_query_ptr.value().stops_count_))
+						.Key("unique_stop_count"sv).Value(static_cast<int>(bus_query_ptr.value().unique_stops_count_))
+					.EndDict();
+				return;
+			}
+
+			writer.StartDict()
+					.Key("error_message"sv).Value("not found"sv)
+					.Key("request_id"sv).Value(json_bus.at("id"sv).AsInt())
+				.EndDict();
+		}
+
+		void JsonReader::ProcessMapQuery(json::Writer& writer, RequestHandler& rh, json::CompactDict json_map) {
+			const int id = json_map.at("id"sv).AsInt();
+
+			// Запрос с областью bbox или тайлом tile рисует только видимую часть карты
+			const auto bbox_it = json_map.find("bbox"sv);
+			const auto tile_it = json_map.find("tile"sv);
+			if (bbox_it != json_map.end() || tile_it != json_map.end()) {
+				const std::optional<geo::BoundingBox> viewport = bbox_it != json_map.end()
+					? LoadBoundingBox(bbox_it->value.AsDict())
+					: LoadTile(tile_it->value.AsDict());
+
+				if (!viewport) {
+					writer.StartDict()
+							.Key("error_message"sv).Value("invalid viewport"sv)
+							.Key("request_id"sv).Value(id)
+						.EndDict();
+					return;
+				}
 
+				writer.StartDict()
+						.Key("map"sv);
+				const svg::Document map = bbox_it != json_map.end()
+					? rh.RenderMapViewport(*viewport)
+					: rh.RenderMapTile(*viewport);
+				map.Render(writer.StartString());
+				writer.EndString()
+						.Key("request_id"sv).Value(id)
+					.EndDict();
+				return;
 			}
 
-			return json::Node{ json::Builder{}
-								.StartDict()
-									.Key("error_message"s).Value("not found"s)
-									.Key("request_id"s).Value(json_bus.at("id").AsInt())
-								.EndDict()
-				                .Build()
-			};
+			// Текст карты экранируется один раз и запоминается вместе с исходным текстом:
+			// повторные запросы к той же версии справочника сводятся к копированию готовой строки
+			const auto map_text = rh.RenderMapText();
+			if (map_text != escaped_map_source_) {
+				escaped_map_ = json::EscapeString(*map_text);
+				escaped_map_source_ = map_text;
+			}
+
+			writer.StartDict()
+					.Key("map"sv).EscapedValue(escaped_map_)
+					.Key("request_id"sv).Value(id)
+				.EndDict();
 		}
 
-		const json::Node JsonReader::ProcessMapQuery(RequestHandler& rh, const json::Dict& json_map) {
+		std::optional<geo::BoundingBox> JsonReader::LoadBoundingBox(json::CompactDict json_bbox) {
+			const geo::BoundingBox bbox{
+				json_bbox.at("min_lat"sv).AsDouble(),
+				json_bbox.at("min_lng"sv).AsDouble(),
+				json_bbox.at("max_lat"sv).AsDouble(),
+				json_bbox.at("max_lng"sv).AsDouble()
+			};
+			if (!bbox.IsValid()) {
+				return std::nullopt;
+			}
+			return bbox;
+		}
 
-			svg::Document svg_map = rh.RenderMap();
-			std::ostringstream os_stream;
-			svg_map.Render(os_stream);
+		std::optional<geo::BoundingBox> JsonReader::LoadTile(json::CompactDict json_tile) {
+			// Больше 30 уровней не даёт int-координат тайла
+			const int max_zoom = 30;
 
-			return json::Node{ json::Builder{}
-											.StartDict()
-												.Key("map"s).Value(os_stream.str())
-												.Key("request_id"s).Value(json_map.at("id"s).AsInt())
-											.EndDict()
-				                            .Build() };
+			const int zoom = json_tile.at("z"sv).AsInt();
+			const int x = json_tile.at("x"sv).AsInt();
+			const int y = json_tile.at("y"sv).AsInt();
+			if (zoom < 0 || zoom > max_zoom || x < 0 || y < 0 || x >= (1 << zoom) || y >= (1 << zoom)) {
+				return std::nullopt;
+			}
+			return geo::GetTileBounds(zoom, x, y);
 		}
 
-		const json::Node JsonReader::ProcessRoutingQuery(RequestHandler& rh, const json::Dict& json_map) {
-			const int id = json_map.at("id"s).AsInt();
-			const std::string stop_from = json_map.at("from"s).AsString();
-			const std::string stop_to = json_map.at("to"s).AsString();
+		void JsonReader::ProcessRoutingQuery(json::Writer& writer, RequestHandler& rh, json::CompactDict json_map) {
+			const int id = json_map.at("id"sv).AsInt();
+			const std::string stop_from(json_map.at("from"sv).AsString());
+			const std::string stop_to(json_map.at("to"sv).AsString());
 			const auto tr_info = rh.GetRoute(stop_from, stop_to);
 
 			if (tr_info.info) {
-				json::Array items;
 				double total_time = 0.0;
 
-				items.reserve(tr_info.info.value().edges.size());
+				writer.StartDict()
+						.Key("items"sv).StartArray();
 				for (const auto& edge : tr_info.edges) {
 
 					if (edge.quality == 0) {
-						items.emplace_back(json::Node(json::Builder{}
-							.StartDict()
-							    .Key("stop_name"s).Value(edge.name)
-							    .Key("time"s).Value(edge.weight)
-							    .Key("type"s).Value("Wait"s)
-							.EndDict()
-						.Build()));
+						writer.StartDict()
+								.Key("stop_name"sv).Value(edge.name)
+								.Key("time"sv).Value(edge.weight)
+								.Key("type"sv).Value("Wait"sv)
+							.EndDict();
 
 						total_time += edge.weight;
 					}
 					else {
-						items.emplace_back(json::Node(json::Builder{}
-							.StartDict()
-							    .Key("bus"s).Value(edge.name)
-							    .Key("span_count"s).Value(static_cast<int>(edge.quality))
-							    .Key("time"s).Value(edge.weight)
-							    .Key("type"s).Value("Bus"s)
-							.EndDict()
-						.Build()));
+						writer.StartDict()
+								.Key("bus"sv).Value(edge.name)
+								.Key("span_count"sv).Value(static_cast<int>(edge.quality))
+								.Key("time"sv).Value(edge.weight)
+								.Key("type"sv).Value("Bus"sv)
+							.EndDict();
 
 						total_time += edge.weight;
 					}
 				}
 
-				auto res = json::Node{ json::Builder{}
-					.StartDict()
-						.Key("request_id"s).Value(id)
-						.Key("total_time"s).Value(total_time)
-						.Key("items"s).Value(items)
-					.EndDict()
-				.Build() };
+				writer.EndArray();
 
-				return res;
+				// С флагом render к ответу прилагается карта поездки
+				if (const auto render_it = json_map.find("render"sv); render_it != json_map.end() && render_it->value.AsBool()) {
+					writer.Key("map"sv);
+					rh.RenderRoute(tr_info).Render(writer.StartString());
+					writer.EndString();
+				}
+
+				writer.Key("request_id"sv).Value(id)
+						.Key("total_time"sv).Value(total_time)
+					.EndDict();
 			}
 			else {
-				return json::Node{ json::Builder{}
-					.StartDict()
-						.Key("request_id"s).Value(id)
-						.Key("error_message"s).Value("not found"s)
-					.EndDict()
-				.Build()
-				};
+				writer.StartDict()
+						.Key("error_message"sv).Value("not found"sv)
+						.Key("request_id"sv).Value(id)
+					.EndDict();
 			}
 		}
 
-		const svg::Color JsonReader::GetColor(const json::Node& color)
+		void JsonReader::ProcessNearbyStopsQuery(json::Writer& writer, RequestHandler& rh, json::CompactDict json_nearby) {
+			const int id = json_nearby.at("id"sv).AsInt();
+
+			std::optional<double> radius;
+			if (const auto radius_it = json_nearby.find("radius"sv); radius_it != json_nearby.end()) {
+				radius = radius_it->value.AsDouble();
+			}
+
+			std::optional<size_t> count;
+			if (const auto count_it = json_nearby.find("count"sv); count_it != json_nearby.end()) {
+				count = static_cast<size_t>(std::max(count_it->value.AsInt(), 0));
+			}
+
+			if (!radius && !count) {
+				writer.StartDict()
+						.Key("error_message"sv).Value("radius or count required"sv)
+						.Key("request_id"sv).Value(id)
+					.EndDict();
+				return;
+			}
+
+			const auto nearby_stops = rh.GetNearbyStops(
+				{ json_nearby.at("latitude"sv).AsDouble(), json_nearby.at("longitude"sv).AsDouble() }, radius, count);
+
+			writer.StartDict()
+					.Key("request_id"sv).Value(id)
+					.Key("stops"sv).StartArray();
+			for (const geo::Neighbour& stop : nearby_stops) {
+				writer.StartDict()
+						.Key("distance"sv).Value(stop.distance)
+						.Key("name"sv).Value(rh.GetStopById(stop.id).name_)
+					.EndDict();
+			}
+			writer.EndArray()
+				.EndDict();
+		}
+
+		const svg::Color JsonReader::GetColor(const json::CompactNode& color)
 		{
 			if (color.IsString())
 			{
-				return svg::Color{ color.AsString() };
+				return svg::Color{ std::string(color.AsString()) };
 			}
 			else if (color.IsArray())
 			{
@@ -312,35 +840,39 @@ namespace transport {
 			return svg::Color();
 		}
 
-		void JsonReader::LoadRendererSettings(renderer::MapRenderer& mr, const json::Dict& json_dict) {
+		void JsonReader::LoadRendererSettings(renderer::MapRenderer& mr, json::CompactDict json_dict) {
 			renderer::RendererSettings loaded_settings;
 
-			loaded_settings.width = json_dict.at("width").AsDouble();
-			loaded_settings.height = json_dict.at("height").AsDouble();
-			loaded_settings.padding = json_dict.at("padding").AsDouble();
-			loaded_settings.line_width = json_dict.at("line_width").AsDouble();
-			loaded_settings.stop_radius = json_dict.at("stop_radius").AsDouble();
-			loaded_settings.bus_label_font_size = json_dict.at("bus_label_font_size").AsInt();
-			loaded_settings.bus_label_offset = { json_dict.at("bus_label_offset").AsArray()[0].AsDouble(), json_dict.at("bus_label_offset").AsArray()[1].AsDouble() };
-			loaded_settings.stop_label_font_size = json_dict.at("stop_label_font_size").AsInt();
-			loaded_settings.stop_label_offset = { json_dict.at("stop_label_offset").AsArray()[0].AsDouble(), json_dict.at("stop_label_offset").AsArray()[1].AsDouble() };
-			loaded_settings.underlayer_color = GetColor(json_dict.at("underlayer_color"));
-			loaded_settings.underlayer_width = json_dict.at("underlayer_width").AsDouble();
+			loaded_settings.width = json_dict.at("width"sv).AsDouble();
+			loaded_settings.height = json_dict.at("height"sv).AsDouble();
+			loaded_settings.padding = json_dict.at("padding"sv).AsDouble();
+			loaded_settings.line_width = json_dict.at("line_width"sv).AsDouble();
+			loaded_settings.stop_radius = json_dict.at("stop_radius"sv).AsDouble();
+			loaded_settings.bus_label_font_size = json_dict.at("bus_label_font_size"sv).AsInt();
+			loaded_settings.bus_label_offset = { json_dict.at("bus_label_offset"sv).AsArray()[0].AsDouble(), json_dict.at("bus_label_offset"sv).AsArray()[1].AsDouble() };
+			loaded_settings.stop_label_font_size = json_dict.at("stop_label_font_size"sv).AsInt();
+			loaded_settings.stop_label_offset = { json_dict.at("stop_label_offset"sv).AsArray()[0].AsDouble(), json_dict.at("stop_label_offset"sv).AsArray()[1].AsDouble() };
+			loaded_settings.underlayer_color = GetColor(json_dict.at("underlayer_color"sv));
+			loaded_settings.underlayer_width = json_dict.at("underlayer_width"sv).AsDouble();
 			loaded_settings.color_palette.clear();
 
-			for (const auto& color : json_dict.at("color_palette").AsArray())
+			for (const auto& color : json_dict.at("color_palette"sv).AsArray())
 			{
 				loaded_settings.color_palette.emplace_back(GetColor(color));
 			}
 
+			if (const auto tolerance_it = json_dict.find("simplify_tolerance"sv); tolerance_it != json_dict.end()) {
+				loaded_settings.simplify_tolerance = tolerance_it->value.AsDouble();
+			}
+
 			mr = loaded_settings;
 		}
 
-		transport::RouterSettings JsonReader::LoadRoutingSettings(const json::Dict& json_dict) {
+		transport::RouterSettings JsonReader::LoadRoutingSettings(json::CompactDict json_dict) {
 			transport::RouterSettings loaded_settings;
 
-			loaded_settings.bus_velocity = json_dict.at("bus_velocity").AsInt();
-			loaded_settings.bus_wait_time = json_dict.at("bus_wait_time").AsInt();
+			loaded_settings.bus_velocity = json_dict.at("bus_velocity"sv).AsInt();
+			loaded_settings.bus_wait_time = json_dict.at("bus_wait_time"sv).AsInt();
 
 			return loaded_settings;
 		}
@@ -4,45 +4,63 @@
  * Здесь можно разместить код наполнения транспортного справочника данными из JSON,
  * а также код обработки запросов к базе и формирование массива ответов в формате JSON
  */
+#include "catalogue_store.h"
 #include "json.h"
+#include "json_compact.h"
+#include "json_writer.h"
 #include "map_renderer.h"
 #include "request_handler.h"
 #include "transport_catalogue.h"
 #include "transport_router.h"
 
+#include <memory>
+#include <optional>
 #include <sstream>
+#include <string>
 
 namespace transport {
     namespace reader {
         class JsonReader {
         public:
 
-            void ProcessJSON(TransportCatalogue& tc, renderer::MapRenderer& mr,
+            // Данные base_requests добавляются в builder, после чего новая версия справочника
+            // публикуется в store. Запросы stat_requests обрабатываются по актуальной версии
+            void ProcessJSON(CatalogueBuilder& builder, CatalogueStore& store, renderer::MapRenderer& mr,
                 std::istream& input, std::ostream& output);
 
         private:
 
-            void AddStopData(TransportCatalogue& tc, const json::Dict& json_stop);
+            void ProcessStopQuery(json::Writer& writer, RequestHandler& rh, json::CompactDict json_stop);
+            void ProcessBusQuery(json::Writer& writer, RequestHandler& rh, json::CompactDict json_bus);
+            void ProcessMapQuery(json::Writer& writer, RequestHandler& rh, json::CompactDict json_map);
 
-            void AddStopDistance(TransportCatalogue& tc, const json::Dict& json_stop);
+            // Область запроса Map: прямоугольник bbox или тайл z/x/y. Некорректная область даёт nullopt
+            std::optional<geo::BoundingBox> LoadBoundingBox(json::CompactDict json_bbox);
+            std::optional<geo::BoundingBox> LoadTile(json::CompactDict json_tile);
+            void ProcessRoutingQuery(json::Writer& writer, RequestHandler& rh, json::CompactDict json_map);
+            void ProcessNearbyStopsQuery(json::Writer& writer, RequestHandler& rh, json::CompactDict json_nearby);
 
-            void AddBusData(TransportCatalogue& tc, const json::Dict& json_bus);
+            // Выполняет запрос stat_requests и записывает ответ; для запроса неизвестного типа ответа нет
+            void ProcessQuery(json::Writer& writer, const CatalogueStore& store, const renderer::MapRenderer& mr,
+                const json::CompactNode& query);
 
-            void FillCatalogue(TransportCatalogue& tc, const json::Array& json_arr);
+            void ProcessQueries(std::ostream& out, const CatalogueStore& store, const renderer::MapRenderer& mr,
+                json::CompactArray json_arr);
 
-            const json::Node ProcessStopQuery(RequestHandler& rh, const json::Dict& json_stop);
-            const json::Node ProcessBusQuery(RequestHandler& rh, const json::Dict& json_bus);
-            const json::Node ProcessMapQuery(RequestHandler& rh, const json::Dict& json_map);
-            const json::Node ProcessRoutingQuery(RequestHandler& rh, const json::Dict& json_map);
+            // Применяет настройки из разделов запроса и публикует новую версию справочника, если она нужна
+            void ApplySettings(CatalogueBuilder& builder, CatalogueStore& store, renderer::MapRenderer& mr,
+                const json::CompactNode* render_settings, const json::CompactNode* routing_settings, bool has_base_requests);
 
-            void ProcessQueries(std::ostream& out, RequestHandler& rh, const json::Array& json_arr);
+            const svg::Color GetColor(const json::CompactNode& color);
 
-            const svg::Color GetColor(const json::Node& color);
+            void LoadRendererSettings(renderer::MapRenderer& mr, json::CompactDict json_dict);
 
-            void LoadRendererSettings(renderer::MapRenderer& mr, const json::Dict& json_dict);
-
-            transport::RouterSettings LoadRoutingSettings(const json::Dict& json_dict);
+            transport::RouterSettings LoadRoutingSettings(json::CompactDict json_dict);
 
+            // Экранированный для JSON текст последней выведенной карты и сам текст, по которому он получен.
+            // Указатель удерживает текст, так что совпадение указателей означает ту же карту
+            std::shared_ptr<const std::string> escaped_map_source_;
+            std::string escaped_map_;
         };
     }
     
@@ -0,0 +1,367 @@
+#include "json_scanner.h"
+#include "json.h"
+#include "cpu_features.h"
+
+#include <bit>
+#include <cstring>
+#include <limits>
+
+#if defined(CPU_DISPATCH_AVX2) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+namespace json {
+
+    namespace {
+        using namespace std::literals;
+
+        constexpr size_t block_size = 64;
+
+        // Битовые маски блока из 64 байт: бит i соответствует i-му байту
+        struct BlockMasks {
+            uint64_t quote = 0;
+            uint64_t backslash = 0;
+            uint64_t whitespace = 0;
+            uint64_t structural = 0;
+        };
+
+#ifdef CPU_DISPATCH_AVX2
+
+        // Маска байтов chars, равных c
+        CPU_TARGET_AVX2 inline __m256i Equals(__m256i chars, char c) {
+            return _mm256_cmpeq_epi8(chars, _mm256_set1_epi8(c));
+        }
+
+        // Биты половины half в 64-битной маске блока
+        CPU_TARGET_AVX2 inline uint64_t ToMask(__m256i matches, size_t half) {
+            return static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(matches))) << (half * 32);
+        }
+
+        CPU_TARGET_AVX2 inline BlockMasks ClassifyBlockAvx2(const char* block) {
+            BlockMasks masks;
+            for (size_t half = 0; half < 2; ++half) {
+                const __m256i chars = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + half * 32));
+
+                // Символы \t \n \v \f \r идут подряд с кода 9, поэтому проверяются одним беззнаковым сравнением
+                const __m256i control = _mm256_sub_epi8(chars, _mm256_set1_epi8(9));
+                const __m256i is_control_space = _mm256_cmpeq_epi8(_mm256_min_epu8(control, _mm256_set1_epi8(4)), control);
+
+                // Установка бита 0x20 переводит [ и ] в { и }
+                const __m256i folded = _mm256_or_si256(chars, _mm256_set1_epi8(0x20));
+                const __m256i is_bracket = _mm256_or_si256(Equals(folded, '{'), Equals(folded, '}'));
+
+                masks.quote |= ToMask(Equals(chars, '"'), half);
+                masks.backslash |= ToMask(Equals(chars, '\\'), half);
+                masks.whitespace |= ToMask(_mm256_or_si256(Equals(chars, ' '), is_control_space), half);
+                masks.structural |= ToMask(_mm256_or_si256(is_bracket, _mm256_or_si256(Equals(chars, ':'), Equals(chars, ','))), half);
+            }
+            return masks;
+        }
+
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64)
+
+        BlockMasks ClassifyBlock(const char* block) {
+            BlockMasks masks;
+            for (size_t quarter = 0; quarter < 4; ++quarter) {
+                const __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + quarter * 16));
+                auto equals = [&chars](char c) {
+                    return _mm_cmpeq_epi8(chars, _mm_set1_epi8(c));
+                };
+                auto to_mask = [quarter](__m128i matches) {
+                    return static_cast<uint64_t>(static_cast<uint32_t>(_mm_movemask_epi8(matches))) << (quarter * 16);
+                };
+
+                // Символы \t \n \v \f \r идут подряд с кода 9, поэтому проверяются одним беззнаковым сравнением
+                const __m128i control = _mm_sub_epi8(chars, _mm_set1_epi8(9));
+                const __m128i is_control_space = _mm_cmpeq_epi8(_mm_min_epu8(control, _mm_set1_epi8(4)), control);
+
+                // Установка бита 0x20 переводит [ и ] в { и }
+                const __m128i folded = _mm_or_si128(chars, _mm_set1_epi8(0x20));
+                const __m128i is_bracket = _mm_or_si128(
+                    _mm_cmpeq_epi8(folded, _mm_set1_epi8('{')), _mm_cmpeq_epi8(folded, _mm_set1_epi8('}')));
+
+                masks.quote |= to_mask(equals('"'));
+                masks.backslash |= to_mask(equals('\\'));
+                masks.whitespace |= to_mask(_mm_or_si128(equals(' '), is_control_space));
+                masks.structural |= to_mask(_mm_or_si128(is_bracket, _mm_or_si128(equals(':'), equals(','))));
+            }
+            return masks;
+        }
+
+#else
+
+        BlockMasks ClassifyBlock(const char* block) {
+            BlockMasks masks;
+            for (size_t i = 0; i < block_size; ++i) {
+                const uint64_t bit = uint64_t{ 1 } << i;
+                switch (block[i]) {
+                case '"':
+                    masks.quote |= bit;
+                    break;
+                case '\\':
+                    masks.backslash |= bit;
+                    break;
+                case ' ': case '\t': case '\n': case '\v': case '\f': case '\r':
+                    masks.whitespace |= bit;
+                    break;
+                case '{': case '}': case '[': case ']': case ':': case ',':
+                    masks.structural |= bit;
+                    break;
+                default:
+                    break;
+                }
+            }
+            return masks;
+        }
+
+#endif
+
+        // Бит i результата равен исключающему ИЛИ битов 0..i аргумента
+        uint64_t PrefixXor(uint64_t bits) {
+            bits ^= bits << 1;
+            bits ^= bits << 2;
+            bits ^= bits << 4;
+            bits ^= bits << 8;
+            bits ^= bits << 16;
+            bits ^= bits << 32;
+            return bits;
+        }
+
+        // Отмечает символы, перед которыми стоит нечётное число обратных косых черт.
+        // Последовательности черт, начинающиеся на чётных и нечётных позициях, разделяются сложением,
+        // так что блок обрабатывается без ветвлений; prev_escaped переносит состояние в следующий блок
+        uint64_t FindEscaped(uint64_t backslash, uint64_t& prev_escaped) {
+            backslash &= ~prev_escaped;
+            const uint64_t follows_escape = backslash << 1 | prev_escaped;
+
+            const uint64_t even_bits = 0x5555555555555555ull;
+            const uint64_t odd_sequence_starts = backslash & ~even_bits & ~follows_escape;
+            const uint64_t sequences_starting_on_even_bits = odd_sequence_starts + backslash;
+            prev_escaped = sequences_starting_on_even_bits < odd_sequence_starts ? 1u : 0u;
+
+            const uint64_t invert_mask = sequences_starting_on_even_bits << 1;
+            return (even_bits ^ invert_mask) & follows_escape;
+        }
+
+        // Записывает позиции установленных битов начиная с out[count] и возвращает новое количество.
+        // Позиции пишутся группами по восемь без проверки, сколько битов осталось: лишние записи
+        // затираются следующим блоком, зато число ветвлений не зависит от плотности лексем
+        size_t FlattenBits(uint64_t bits, uint32_t offset, uint32_t* out, size_t count) {
+            const size_t total = count + std::popcount(bits);
+            while (count < total) {
+                for (int i = 0; i < 8; ++i) {
+                    out[count + i] = offset + static_cast<uint32_t>(std::countr_zero(bits | (uint64_t{ 1 } << 63)));
+                    bits &= bits - 1;
+                }
+                count += 8;
+            }
+            return total;
+        }
+
+        // Классифицирует блоки входа функцией Classify и дописывает позиции лексем
+        // в positions, увеличивая буфер при нехватке места
+        template <BlockMasks (*Classify)(const char*)>
+        inline void IndexBlocks(std::string_view input, std::unique_ptr<uint32_t[]>& positions, size_t& size, size_t& capacity) {
+            uint64_t prev_escaped = 0;
+            uint64_t prev_in_string = 0;
+            uint64_t prev_scalar = 0;
+
+            // Неполный последний блок дополняется пробелами, которые не порождают лексем
+            char tail[block_size];
+
+            for (size_t offset = 0; offset < input.size(); offset += block_size) {
+                const char* block = input.data() + offset;
+                if (input.size() - offset < block_size) {
+                    std::memset(tail, ' ', block_size);
+                    std::memcpy(tail, block, input.size() - offset);
+                    block = tail;
+                }
+
+                const BlockMasks masks = Classify(block);
+
+                // Открывающая кавычка входит в строку, закрывающая — нет, поэтому тело строки — это in_string без кавычек
+                const uint64_t quote = masks.quote & ~FindEscaped(masks.backslash, prev_escaped);
+                const uint64_t in_string = PrefixXor(quote) ^ prev_in_string;
+                prev_in_string = static_cast<uint64_t>(static_cast<int64_t>(in_string) >> 63);
+                const uint64_t string_body = in_string & ~quote;
+
+                // Значение вне строки начинается там, где символ не пробел, не кавычка и не структурный,
+                // а предыдущий символ таким значением не был
+                const uint64_t scalar = ~(masks.structural | masks.whitespace | quote | string_body);
+                const uint64_t follows_scalar = scalar << 1 | prev_scalar;
+                prev_scalar = scalar >> 63;
+
+                const uint64_t tokens = ((masks.structural | quote) & ~string_body) | (scalar & ~follows_scalar);
+
+                // Запас в размер блока позволяет записывать позиции без проверок границ
+                if (capacity < size + block_size) {
+                    capacity *= 2;
+                    std::unique_ptr<uint32_t[]> grown(new uint32_t[capacity]);
+                    std::memcpy(grown.get(), positions.get(), size * sizeof(uint32_t));
+                    positions = std::move(grown);
+                }
+                size = FlattenBits(tokens, static_cast<uint32_t>(offset), positions.get(), size);
+            }
+        }
+
+#ifdef CPU_DISPATCH_AVX2
+        // Проход с классификацией на AVX2: IndexBlocks встраивается сюда и компилируется с тем же набором инструкций
+        CPU_TARGET_AVX2 __attribute__((flatten)) void IndexBlocksAvx2(std::string_view input, std::unique_ptr<uint32_t[]>& positions, size_t& size, size_t& capacity) {
+            IndexBlocks<ClassifyBlockAvx2>(input, positions, size, capacity);
+        }
+#endif
+
+        // Символ после обратной косой черты для каждого особого символа
+        char EscapedChar(char c) {
+            switch (c) {
+            case '\r':
+                return 'r';
+            case '\n':
+                return 'n';
+            case '\t':
+                return 't';
+            default:
+                return c;
+            }
+        }
+
+#ifdef CPU_DISPATCH_AVX2
+        // Векторная часть EscapeChars на AVX2: обрабатывает блоки по 32 байта, пока во входе остаётся не меньше двух блоков,
+        // сдвигает out_end и возвращает начало необработанного остатка. Все особые символы блока разбираются по его маске:
+        // участок между ними копируется одной 32-байтной записью из копии блока, лишнее затирается следующей записью.
+        // Запись уходит не дальше 96 байт от начала вывода блока, а места осталось не меньше чем на 2 * 64 байта
+        CPU_TARGET_AVX2 const char* EscapeBlocksAvx2(const char* begin, const char* end, char*& out_end) {
+            // Запись через char* может задеть любую память, поэтому позиция вывода держится в локальной переменной
+            char* out = out_end;
+
+            // Вторая половина буфера позволяет читать 32 байта с любой позиции блока
+            alignas(32) char block[64];
+            _mm256_store_si256(reinterpret_cast<__m256i*>(block + 32), _mm256_setzero_si256());
+
+            while (end - begin >= 64) {
+                const __m256i chars = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin));
+                const __m256i special = _mm256_or_si256(
+                    _mm256_or_si256(_mm256_cmpeq_epi8(chars, _mm256_set1_epi8('"')), _mm256_cmpeq_epi8(chars, _mm256_set1_epi8('\\'))),
+                    _mm256_or_si256(_mm256_cmpeq_epi8(chars, _mm256_set1_epi8('\n')),
+                        _mm256_or_si256(_mm256_cmpeq_epi8(chars, _mm256_set1_epi8('\r')), _mm256_cmpeq_epi8(chars, _mm256_set1_epi8('\t')))));
+
+                uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(special));
+                if (mask == 0) {
+                    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), chars);
+                    begin += 32;
+                    out += 32;
+                    continue;
+                }
+
+                _mm256_store_si256(reinterpret_cast<__m256i*>(block), chars);
+                size_t copied = 0;
+                for (; mask != 0; mask &= mask - 1) {
+                    const size_t special_pos = std::countr_zero(mask);
+                    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + copied)));
+                    out += special_pos - copied;
+                    *out++ = '\\';
+                    *out++ = EscapedChar(block[special_pos]);
+                    copied = special_pos + 1;
+                }
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + copied)));
+                out += 32 - copied;
+                begin += 32;
+            }
+            out_end = out;
+            return begin;
+        }
+#endif
+
+    }  // namespace
+
+    StructuralIndex::StructuralIndex(std::string_view input) {
+        if (input.size() >= std::numeric_limits<uint32_t>::max()) {
+            throw ParsingError("Input is too large"s);
+        }
+        // Обычно лексем заметно меньше, чем байт на четыре; если их больше, буфер растёт вдвое
+        capacity_ = input.size() / 4 + block_size;
+        positions_.reset(new uint32_t[capacity_]);
+
+#ifdef CPU_DISPATCH_AVX2
+        if (cpu::HasAvx2()) {
+            IndexBlocksAvx2(input, positions_, size_, capacity_);
+            return;
+        }
+#endif
+        IndexBlocks<ClassifyBlock>(input, positions_, size_, capacity_);
+    }
+
+    const char* FindStringSpecial(const char* begin, const char* end) {
+#if defined(__SSE2__) || defined(_M_X64)
+        const __m128i backslash = _mm_set1_epi8('\\');
+        const __m128i line_feed = _mm_set1_epi8('\n');
+        const __m128i carriage_return = _mm_set1_epi8('\r');
+
+        for (; end - begin >= 16; begin += 16) {
+            const __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+            const __m128i special = _mm_or_si128(_mm_cmpeq_epi8(chars, backslash),
+                _mm_or_si128(_mm_cmpeq_epi8(chars, line_feed), _mm_cmpeq_epi8(chars, carriage_return)));
+
+            if (const int mask = _mm_movemask_epi8(special); mask != 0) {
+                return begin + std::countr_zero(static_cast<unsigned>(mask));
+            }
+        }
+#endif
+        for (; begin != end; ++begin) {
+            if (*begin == '\\' || *begin == '\n' || *begin == '\r') {
+                return begin;
+            }
+        }
+        return end;
+    }
+
+    char* EscapeChars(std::string_view value, char* out) {
+        const char* begin = value.data();
+        const char* const end = begin + value.size();
+
+        // Пока во входе остаётся целый блок, запись блока не выходит за 2 * value.size():
+        // вывод не опережает вход более чем вдвое, а после блока остаётся не меньше его длины
+#ifdef CPU_DISPATCH_AVX2
+        if (end - begin >= 64 && cpu::HasAvx2()) {
+            begin = EscapeBlocksAvx2(begin, end, out);
+        }
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+        while (end - begin >= 16) {
+            const __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out), chars);
+            const __m128i special = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(chars, _mm_set1_epi8('"')), _mm_cmpeq_epi8(chars, _mm_set1_epi8('\\'))),
+                _mm_or_si128(_mm_cmpeq_epi8(chars, _mm_set1_epi8('\n')),
+                    _mm_or_si128(_mm_cmpeq_epi8(chars, _mm_set1_epi8('\r')), _mm_cmpeq_epi8(chars, _mm_set1_epi8('\t')))));
+
+            const int mask = _mm_movemask_epi8(special);
+            if (mask == 0) {
+                begin += 16;
+                out += 16;
+                continue;
+            }
+            const int clean = std::countr_zero(static_cast<unsigned>(mask));
+            begin += clean;
+            out += clean;
+            *out++ = '\\';
+            *out++ = EscapedChar(*begin++);
+        }
+#endif
+        for (; begin != end; ++begin) {
+            switch (*begin) {
+            case '"': case '\\': case '\n': case '\r': case '\t':
+                *out++ = '\\';
+                *out++ = EscapedChar(*begin);
+                break;
+            default:
+                *out++ = *begin;
+                break;
+            }
+        }
+        return out;
+    }
+
+}  // namespace json
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string_view>
+
+namespace json {
+
+    // Первый этап разбора: за один векторный проход по входу находит позиции всех лексем.
+    // В индекс попадают структурные символы { } [ ] : , вне строк, открывающие и закрывающие
+    // кавычки строк и первые символы прочих значений (чисел и литералов).
+    // Второй этап переходит от лексемы к лексеме по индексу и не просматривает пробелы и тела строк.
+    // Вход обрабатывается блоками по 64 байта: если процессор поддерживает AVX2 (проверяется при выполнении),
+    // по два 32-байтных вектора, иначе с SSE2 по четыре 16-байтных, без них — скалярно.
+    // Результат от набора инструкций не зависит
+    class StructuralIndex {
+    public:
+        // Позиции хранятся как uint32_t, поэтому вход должен быть меньше 4 ГиБ
+        explicit StructuralIndex(std::string_view input);
+
+        const uint32_t* begin() const {
+            return positions_.get();
+        }
+
+        const uint32_t* end() const {
+            return positions_.get() + size_;
+        }
+
+        size_t size() const {
+            return size_;
+        }
+
+    private:
+        // Буфер не инициализируется при выделении: позиции записываются сразу на место
+        std::unique_ptr<uint32_t[]> positions_;
+        size_t size_ = 0;
+        size_t capacity_ = 0;
+    };
+
+    // Возвращает первый символ из [begin, end), требующий особой обработки в теле строки:
+    // обратную косую черту или перевод строки. Если таких нет, возвращает end
+    const char* FindStringSpecial(const char* begin, const char* end);
+
+    // Записывает value в out с экранированием, как при выводе JSON, и возвращает конец записанного.
+    // В out должно быть место для 2 * value.size() символов: каждый символ превращается не более чем в два.
+    // Блоки по 16 или 32 байта копируются в out целиком, после чего вывод продолжается с первого особого
+    // символа блока, так что строки без особых символов копируются без посимвольной обработки
+    char* EscapeChars(std::string_view value, char* out);
+
+}  // namespace json
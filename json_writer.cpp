@@ -0,0 +1,249 @@
+#include "json_writer.h"
+#include "json_scanner.h"
+
+#include <charconv>
+#include <stdexcept>
+#include <system_error>
+
+namespace json {
+
+    using namespace std::literals;
+
+    namespace {
+        constexpr size_t indent_step = 4;
+
+        // Наибольшая длина double в формате %g с запасом
+        constexpr size_t max_number_length = 32;
+
+        constexpr size_t flush_threshold = 64 * 1024;
+    }
+
+    std::string EscapeString(std::string_view value) {
+        std::string result(2 * value.size(), '\0');
+        result.resize(EscapeChars(value, result.data()) - result.data());
+        return result;
+    }
+
+    // Собирает текст строкового значения в небольшой области и передаёт её писателю порциями,
+    // так что отдельные операторы << не вызывают виртуальных функций
+    class Writer::StringBuffer final : public std::streambuf {
+    public:
+        explicit StringBuffer(Writer& writer) :
+            writer_(writer) {
+            setp(chunk_, chunk_ + chunk_size);
+        }
+
+    protected:
+        int_type overflow(int_type c) override {
+            sync();
+            if (!traits_type::eq_int_type(c, traits_type::eof())) {
+                *pptr() = traits_type::to_char_type(c);
+                pbump(1);
+            }
+            return traits_type::not_eof(c);
+        }
+
+        int sync() override {
+            writer_.AppendEscaped({ pbase(), static_cast<size_t>(pptr() - pbase()) });
+            setp(chunk_, chunk_ + chunk_size);
+            return 0;
+        }
+
+    private:
+        static constexpr size_t chunk_size = 4096;
+
+        Writer& writer_;
+        char chunk_[chunk_size];
+    };
+
+    Writer::Writer(std::ostream& output) :
+        output_(output) {
+    }
+
+    Writer::~Writer() = default;
+
+    Writer& Writer::StartDict() {
+        BeforeValue();
+        buffer_.append("{\n"sv);
+        stack_.push_back({ true, true });
+        return *this;
+    }
+
+    Writer& Writer::Key(std::string_view key) {
+        CheckNoString();
+        if (stack_.empty() || !stack_.back().is_dict || after_key_) {
+            throw std::logic_error("Key can't be called now."s);
+        }
+        BeforeElement();
+        WriteString(key);
+        buffer_.append(": "sv);
+        after_key_ = true;
+        return *this;
+    }
+
+    Writer& Writer::EndDict() {
+        return EndContainer(true);
+    }
+
+    Writer& Writer::StartArray() {
+        BeforeValue();
+        buffer_.append("[\n"sv);
+        stack_.push_back({ false, true });
+        return *this;
+    }
+
+    Writer& Writer::EndArray() {
+        return EndContainer(false);
+    }
+
+    Writer& Writer::Value(std::string_view value) {
+        BeforeValue();
+        WriteString(value);
+        return *this;
+    }
+
+    Writer& Writer::Value(const char* value) {
+        return Value(std::string_view(value));
+    }
+
+    Writer& Writer::Value(int value) {
+        BeforeValue();
+        char chars[max_number_length];
+        const auto result = std::to_chars(chars, chars + max_number_length, value);
+        buffer_.append(chars, result.ptr);
+        return *this;
+    }
+
+    Writer& Writer::Value(double value) {
+        BeforeValue();
+        char chars[max_number_length];
+        // Шесть значащих цифр, как при выводе double в std::ostream
+        const auto result = std::to_chars(chars, chars + max_number_length, value, std::chars_format::general, 6);
+        buffer_.append(chars, result.ptr);
+        return *this;
+    }
+
+    Writer& Writer::Value(bool value) {
+        BeforeValue();
+        buffer_.append(value ? "true"sv : "false"sv);
+        return *this;
+    }
+
+    Writer& Writer::Value(std::nullptr_t) {
+        BeforeValue();
+        buffer_.append("null"sv);
+        return *this;
+    }
+
+    std::ostream& Writer::StartString() {
+        BeforeValue();
+        buffer_.push_back('"');
+        in_string_ = true;
+
+        if (!string_stream_) {
+            string_buffer_ = std::make_unique<StringBuffer>(*this);
+            string_stream_ = std::make_unique<std::ostream>(string_buffer_.get());
+        }
+        string_stream_->clear();
+        return *string_stream_;
+    }
+
+    Writer& Writer::EndString() {
+        if (!in_string_) {
+            throw std::logic_error("EndString can't be called now."s);
+        }
+        string_stream_->flush();
+        in_string_ = false;
+        buffer_.push_back('"');
+        return *this;
+    }
+
+    Writer& Writer::EscapedValue(std::string_view escaped) {
+        BeforeValue();
+        buffer_.push_back('"');
+        buffer_.append(escaped);
+        buffer_.push_back('"');
+        FlushIfFull();
+        return *this;
+    }
+
+    void Writer::Flush() {
+        output_.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+        buffer_.clear();
+    }
+
+    void Writer::FlushIfFull() {
+        if (buffer_.size() >= flush_threshold) {
+            Flush();
+        }
+    }
+
+    void Writer::BeforeValue() {
+        CheckNoString();
+        if (after_key_) {
+            after_key_ = false;
+            return;
+        }
+        if (!stack_.empty()) {
+            if (stack_.back().is_dict) {
+                throw std::logic_error("Value can't be called now."s);
+            }
+            BeforeElement();
+        }
+    }
+
+    void Writer::BeforeElement() {
+        Frame& frame = stack_.back();
+        if (frame.first) {
+            frame.first = false;
+        }
+        else {
+            buffer_.append(",\n"sv);
+        }
+        WriteIndent(stack_.size());
+    }
+
+    void Writer::WriteIndent(size_t depth) {
+        buffer_.append(depth * indent_step, ' ');
+    }
+
+    // Экранируются те же символы, что и в json::Print. Место под худший случай выделяется заранее,
+    // и строка экранируется прямо в буфер, после чего лишнее отрезается
+    void Writer::WriteString(std::string_view value) {
+        const size_t start = buffer_.size();
+        buffer_.resize(start + 2 * value.size() + 2);
+
+        char* out = buffer_.data() + start;
+        *out++ = '"';
+        out = EscapeChars(value, out);
+        *out++ = '"';
+        buffer_.resize(out - buffer_.data());
+    }
+
+    void Writer::AppendEscaped(std::string_view chars) {
+        const size_t start = buffer_.size();
+        buffer_.resize(start + 2 * chars.size());
+        buffer_.resize(EscapeChars(chars, buffer_.data() + start) - buffer_.data());
+        FlushIfFull();
+    }
+
+    void Writer::CheckNoString() const {
+        if (in_string_) {
+            throw std::logic_error("String value is not finished."s);
+        }
+    }
+
+    Writer& Writer::EndContainer(bool is_dict) {
+        CheckNoString();
+        if (stack_.empty() || stack_.back().is_dict != is_dict || after_key_) {
+            throw std::logic_error(is_dict ? "EndDict can't be called now."s : "EndArray can't be called now."s);
+        }
+        stack_.pop_back();
+        buffer_.push_back('\n');
+        WriteIndent(stack_.size());
+        buffer_.push_back(is_dict ? '}' : ']');
+        FlushIfFull();
+        return *this;
+    }
+
+}  // namespace json
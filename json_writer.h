@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace json {
+
+    // Экранирует текст строкового значения так же, как Writer::Value, но без кавычек
+    std::string EscapeString(std::string_view value);
+
+    // Пишет JSON сразу в растущий буфер, минуя построение Node.
+    // Интерфейс повторяет Builder: StartDict/Key/Value/EndDict и StartArray/Value/EndArray.
+    // Вывод совпадает с json::Print, если ключи словарей передаются по возрастанию,
+    // как их упорядочивает Dict. Нарушение порядка вызовов выбрасывает std::logic_error
+    class Writer {
+        class StringBuffer;
+
+    public:
+        // Буфер выводится в output порциями, как только превышает 64 КиБ, в том числе посреди длинной строки,
+        // так что память писателя не зависит от объёма вывода
+        explicit Writer(std::ostream& output);
+
+        Writer(const Writer&) = delete;
+        Writer& operator=(const Writer&) = delete;
+
+        ~Writer();
+
+        Writer& StartDict();
+        Writer& Key(std::string_view key);
+        Writer& EndDict();
+
+        Writer& StartArray();
+        Writer& EndArray();
+
+        Writer& Value(std::string_view value);
+        Writer& Value(const char* value);
+        Writer& Value(int value);
+        Writer& Value(double value);
+        Writer& Value(bool value);
+        Writer& Value(std::nullptr_t);
+
+        // Начинает строковое значение, текст которого передаётся в возвращаемый поток по частям
+        // и экранируется по мере записи. До EndString другие методы вызывать нельзя
+        std::ostream& StartString();
+        Writer& EndString();
+
+        // Записывает строковое значение, уже экранированное по правилам JSON, без повторного экранирования
+        Writer& EscapedValue(std::string_view escaped);
+
+        // Выводит накопленный текст в поток, заданный при создании, и очищает буфер.
+        // Состояние открытых контейнеров сохраняется
+        void Flush();
+
+    private:
+        struct Frame {
+            bool is_dict = false;
+            bool first = true;
+        };
+
+        // Вызывается перед каждым значением: ставит разделитель и отступ элемента контейнера
+        void BeforeValue();
+        void BeforeElement();
+        void WriteIndent(size_t depth);
+        void WriteString(std::string_view value);
+        Writer& EndContainer(bool is_dict);
+        void CheckNoString() const;
+
+        // Дописывает в буфер экранированный текст открытой строки
+        void AppendEscaped(std::string_view chars);
+        void FlushIfFull();
+
+        std::ostream& output_;
+
+        std::string buffer_;
+        std::vector<Frame> stack_;
+        // После Key ожидается значение этого ключа
+        bool after_key_ = false;
+
+        // Поток открытой строки и его буфер создаются при первом StartString
+        std::unique_ptr<StringBuffer> string_buffer_;
+        std::unique_ptr<std::ostream> string_stream_;
+        bool in_string_ = false;
+    };
+
+}  // namespace json
@@ -15,12 +15,13 @@ int main()
     std::ifstream in ("s10_final_opentest_1.txt"s);
     std::ofstream out("output_s10_final_opentest_1.txt"s);
 
-    transport::TransportCatalogue tc;
+    transport::CatalogueBuilder builder;
+    transport::CatalogueStore store;
     transport::renderer::MapRenderer mr;
     transport::reader::JsonReader jr;
 
 
-    jr.ProcessJSON(tc, mr, std::cin, std::cout);
+    jr.ProcessJSON(builder, store, mr, std::cin, std::cout);
     //rh.RenderMap().Render(out);
     //rh.RenderMap().Render(std::cout);
 }
\ No newline at end of file
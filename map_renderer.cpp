@@ -1,5 +1,11 @@
 #include "map_renderer.h"
 
+#include <algorithm>
+#include <array>
+#include <future>
+#include <system_error>
+#include <thread>
+
 /*
  * В этом файле вы можете разместить код, отвечающий за визуализацию карты маршрутов в формате SVG.
  * Визуализация маршртутов вам понадобится во второй части итогового проекта.
@@ -15,15 +21,82 @@ namespace transport {
 			return std::abs(value) < EPSILON;
 		}
 
+		namespace {
+			// Допуск самого точного уровня упрощения в градусах, множитель между уровнями и число уровней.
+			// Самый грубый уровень, около 0.04 градуса, подходит для карты области целиком
+			constexpr double lod_base_tolerance = 1e-5;
+			constexpr double lod_level_factor = 4.0;
+			constexpr size_t lod_level_count = 7;
+
+			// Карта меньше этого числа фигур рисуется в одном потоке: запуск задач обошёлся бы дороже.
+			// Отрезок параллельного вывода содержит не меньше parallel_min_part элементов,
+			// а одновременно работают не больше parallel_max_tasks задач, включая вызывающий поток
+			constexpr size_t parallel_min_shapes = 4096;
+			constexpr size_t parallel_min_part = 2048;
+			constexpr size_t parallel_max_tasks = 4;
+
+			// Запускает job в отдельном потоке. Если система не смогла создать поток, job выполняется сразу
+			// в вызывающем потоке и возвращается пустое будущее, так что вывод просто становится последовательным
+			template <typename Job>
+			std::future<void> RunAsync(const Job& job) {
+				try {
+					return std::async(std::launch::async, job);
+				}
+				catch (const std::system_error&) {
+					job();
+					return {};
+				}
+			}
+
+			void Wait(std::future<void>& task) {
+				if (task.valid()) {
+					task.get();
+				}
+			}
+		}
+
 		//------------------------ SphereProjector -------------------------
 
 		svg::Point SphereProjector::operator()(geo::Coordinates coords) const {
+			if (mercator_) {
+				return {
+					(coords.lng - min_lon_) * zoom_coeff_ + padding_,
+					(max_lat_ - geo::MercatorY(coords.lat)) * height_zoom_ + padding_
+				};
+			}
 			return {
 				(coords.lng - min_lon_) * zoom_coeff_ + padding_,
 				(max_lat_ - coords.lat) * zoom_coeff_ + padding_
 			};
 		}
 
+		SphereProjector SphereProjector::FromArea(const geo::BoundingBox& area, double max_width, double max_height, double padding) {
+			const geo::Coordinates corners[] = { { area.min_lat, area.min_lng }, { area.max_lat, area.max_lng } };
+			return SphereProjector(std::begin(corners), std::end(corners), max_width, max_height, padding);
+		}
+
+		SphereProjector SphereProjector::FromTile(const geo::BoundingBox& tile, double width, double height, double padding) {
+			SphereProjector result;
+			result.mercator_ = true;
+			result.padding_ = padding;
+			result.min_lon_ = tile.min_lng;
+			result.max_lat_ = geo::MercatorY(tile.max_lat);
+
+			const double tile_width = tile.max_lng - tile.min_lng;
+			const double tile_height = result.max_lat_ - geo::MercatorY(tile.min_lat);
+			if (!IsZero(tile_width)) {
+				result.zoom_coeff_ = (width - 2 * padding) / tile_width;
+			}
+			if (!IsZero(tile_height)) {
+				result.height_zoom_ = (height - 2 * padding) / tile_height;
+			}
+			return result;
+		}
+
+		double SphereProjector::GetZoom() const {
+			return zoom_coeff_;
+		}
+
 		//------------------------ RoteLine -------------------------
 
 		RouteLine::RouteLine(const std::vector<svg::Point>& points, svg::Color stroke_color, const RendererSettings& settings) :
@@ -49,222 +122,535 @@ namespace transport {
 			settings_(settings){}
 
 
-		svg::Polyline MapRenderer::RenderPolyline(std::vector<const domain::Stop*> route_stops, size_t& color_count, const SphereProjector& sp) const {
-			svg::Polyline temp_line;
-
-			for (const auto& stop : route_stops) {
-				temp_line.AddPoint(sp(stop->coordinate_));
-			}
-
-			temp_line.SetStrokeColor(settings_.color_palette[color_count]);
-			temp_line.SetFillColor("none");
-			temp_line.SetStrokeWidth(settings_.line_width);
-			temp_line.SetStrokeLineCap(svg::StrokeLineCap::ROUND);
-			temp_line.SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
-
-			if (color_count < (settings_.color_palette.size() - 1)) {
-				color_count++;
-			} else {
-				color_count = 0;
-			}
-
-			return temp_line;
+		void MapRenderer::StartRouteLine(svg::Document& doc, size_t color) const {
+			doc.AddPolyline()
+				.SetStrokeColor(settings_.color_palette[color])
+				.SetFillColor("none")
+				.SetStrokeWidth(settings_.line_width)
+				.SetStrokeLineCap(svg::StrokeLineCap::ROUND)
+				.SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
 		}
 
-		std::vector<svg::Polyline> MapRenderer::GetRouteLines(
-			const std::map<std::string_view, domain::Bus*>& buses, const SphereProjector& sp) const {
+		void MapRenderer::RenderPolyline(svg::Document& doc, const DrawnBus& drawn, const StopPositions& positions) const {
+			StartRouteLine(doc, drawn.color);
 
-			std::vector<svg::Polyline> result;
-			size_t color_count = 0;
-
-			for (const auto& [busname, bus] : buses) {
-
-				if (bus->stops_.empty()) {
-					continue;
+			if (drawn.lod) {
+				const size_t id = drawn.bus->id_;
+				for (uint32_t i = drawn.lod->offsets[id]; i < drawn.lod->offsets[id + 1]; ++i) {
+					doc.AddPolylinePoint(positions(drawn.bus->GetRouteStop(drawn.lod->points[i])));
 				}
-
-				std::vector<const domain::Stop*> route_stops { bus->stops_.begin(), bus->stops_.end() };
-
-				svg::Polyline line = RenderPolyline(route_stops, color_count, sp);
-				
-				result.push_back(line);
+				return;
 			}
 
-			return result;
+			for (const domain::Stop* stop : drawn.bus->GetRoute()) {
+				doc.AddPolylinePoint(positions(stop));
+			}
 		}
 
-		svg::Text MapRenderer::FillBusnameText(const domain::Bus* bus, const size_t& color_count, const SphereProjector& sp) const {
-			svg::Text text;
+		void MapRenderer::AddRouteLines(svg::Document& doc, std::span<const DrawnBus> buses, const StopPositions& positions) const {
+			for (const DrawnBus& drawn : buses) {
+				RenderPolyline(doc, drawn, positions);
+			}
+		}
 
-			text.SetPosition(sp(bus->stops_[0]->coordinate_));
+		void MapRenderer::FillBusnameText(svg::Text& text, const domain::Bus& bus, size_t color_count, svg::Point position) const {
+			text.SetPosition(position);
 			text.SetOffset(settings_.bus_label_offset);
 			text.SetFontSize(settings_.bus_label_font_size);
 			text.SetFontFamily("Verdana");
 			text.SetFontWeight("bold");
-			text.SetData(bus->name_);
+			text.SetData(std::string(bus.name_));
 			text.SetFillColor(settings_.color_palette[color_count]);
-
-			return text;
 		}
 
-		svg::Text MapRenderer::FillBusnameUnderlabel(const domain::Bus* bus, const SphereProjector& sp) const {
-
-			svg::Text underlabel;
-
-			underlabel.SetPosition(sp(bus->stops_[0]->coordinate_));
+		void MapRenderer::FillBusnameUnderlabel(svg::Text& underlabel, const domain::Bus& bus, svg::Point position) const {
+			underlabel.SetPosition(position);
 			underlabel.SetOffset(settings_.bus_label_offset);
 			underlabel.SetFontSize(settings_.bus_label_font_size);
 			underlabel.SetFontFamily("Verdana");
 			underlabel.SetFontWeight("bold");
-			underlabel.SetData(bus->name_);
+			underlabel.SetData(std::string(bus.name_));
 			underlabel.SetFillColor(settings_.underlayer_color);
 			underlabel.SetStrokeColor(settings_.underlayer_color);
 			underlabel.SetStrokeWidth(settings_.underlayer_width);
 			underlabel.SetStrokeLineCap(svg::StrokeLineCap::ROUND);
 			underlabel.SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
-
-			return underlabel;
 		}
 
-		std::vector<svg::Text> MapRenderer::GetBusnameLabels(const std::map<std::string_view, domain::Bus*>& buses, const SphereProjector& sp) const {
-			std::vector<svg::Text> result;
-			size_t color_count = 0;
+		void MapRenderer::AddBusnameLabels(svg::Document& doc, std::span<const DrawnBus> buses, const StopPositions& positions,
+			const geo::BoundingBox* area) const {
 
-			for (const auto& [busname, bus] : buses) {
-				if (bus->stops_.empty()) {
-					continue;
+			const auto add_label = [&](const DrawnBus& drawn, const domain::Stop* stop) {
+				if (area && !area->Contains(stop->coordinate_)) {
+					return;
 				}
+				const svg::Point position = positions(stop);
+				FillBusnameUnderlabel(doc.AddText(), *drawn.bus, position);
+				FillBusnameText(doc.AddText(), *drawn.bus, drawn.color, position);
+			};
 
-				svg::Text text = FillBusnameText(bus, color_count, sp);
+			for (const DrawnBus& drawn : buses) {
+				const domain::Bus& bus = *drawn.bus;
 
+				// Название некольцевого маршрута подписывается и у первой, и у конечной остановки
+				add_label(drawn, bus.stops_[0]);
 
-				if (color_count < (settings_.color_palette.size() - 1)) {
-					color_count++;
-				} 
-				else {
-					color_count = 0;
+				if (bus.is_circular_ == false
+					and bus.stops_[0] != bus.GetLastStop()) {
+					add_label(drawn, bus.GetLastStop());
 				}
+			}
+		}
+
+		void MapRenderer::AddStopIcons(svg::Document& doc, std::span<const domain::Stop* const> stops, const StopPositions& positions) const {
+			for (const domain::Stop* stop : stops) {
+				doc.AddCircle()
+					.SetCenter(positions(stop))
+					.SetRadius(settings_.stop_radius)
+					.SetFillColor("white");
+			}
+		}
+
+		void MapRenderer::FillStopnameText(svg::Text& text, const domain::Stop& stop, svg::Point position) const {
+			text.SetPosition(position);
+			text.SetOffset(settings_.stop_label_offset);
+			text.SetFontSize(settings_.stop_label_font_size);
+			text.SetFontFamily("Verdana");
+			text.SetData(std::string(stop.name_));
+			text.SetFillColor("black");
+		}
+
+		void MapRenderer::FillStopnameUnderlabel(svg::Text& underlabel, const domain::Stop& stop, svg::Point position) const {
+			underlabel.SetPosition(position);
+			underlabel.SetOffset(settings_.stop_label_offset);
+			underlabel.SetFontSize(settings_.stop_label_font_size);
+			underlabel.SetFontFamily("Verdana");
+			underlabel.SetData(std::string(stop.name_));
+			underlabel.SetFillColor(settings_.underlayer_color);
+			underlabel.SetStrokeColor(settings_.underlayer_color);
+			underlabel.SetStrokeWidth(settings_.underlayer_width);
+			underlabel.SetStrokeLineCap(svg::StrokeLineCap::ROUND);
+			underlabel.SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
+		}
+
+		void MapRenderer::AddStopnameLabels(svg::Document& doc, std::span<const domain::Stop* const> stops, const StopPositions& positions) const {
+			for (const domain::Stop* stop : stops) {
+				const svg::Point position = positions(stop);
+				FillStopnameUnderlabel(doc.AddText(), *stop, position);
+				FillStopnameText(doc.AddText(), *stop, position);
+			}
+		}
 
-				svg::Text underlabel = FillBusnameUnderlabel(bus, sp);
+		void MapRenderer::RenderLayers(svg::Document& doc, std::span<const DrawnBus> buses, std::span<const domain::Stop* const> stops,
+			const StopPositions& positions, const geo::BoundingBox* area) const {
 
-				result.push_back(underlabel);
-				result.push_back(text);
+			// Размер документа известен заранее, так что каждый массив фигур выделяется один раз
+			size_t route_points = 0;
+			for (const DrawnBus& drawn : buses) {
+				route_points += drawn.lod
+					? drawn.lod->offsets[drawn.bus->id_ + 1] - drawn.lod->offsets[drawn.bus->id_]
+					: drawn.bus->GetRouteSize();
+			}
+			doc.Reserve(stops.size(), 4 * buses.size() + 2 * stops.size(), buses.size(), route_points);
 
-				if (bus->is_circular_ == false
-					and bus->stops_[0] != bus->stops_[bus->stops_.size() / 2]) {
+			AddRouteLines(doc, buses, positions);
+			AddBusnameLabels(doc, buses, positions, area);
+			AddStopIcons(doc, stops, positions);
+			AddStopnameLabels(doc, stops, positions);
+		}
 
-					svg::Text clone_text{ text };
-					svg::Text clone_underlabel{ underlabel };
+		void MapRenderer::RenderFragments(std::span<const DrawnBus> buses, std::span<BusFragment* const> bus_fragments,
+			std::span<const domain::Stop* const> stops, std::span<StopFragment* const> stop_fragments,
+			const StopPositions& positions) const {
 
-					clone_text.SetPosition(sp(bus->stops_[bus->stops_.size() / 2]->coordinate_));
-					clone_underlabel.SetPosition(sp(bus->stops_[bus->stops_.size() / 2]->coordinate_));
+			// Каждый слой собирается в свой документ; элементы фрагмента i лежат в нём на отрезке [offsets[i], offsets[i + 1]),
+			// а его текст выводится в targets[i]
+			struct Layer {
+				svg::Document doc;
+				std::vector<size_t> offsets;
+				std::vector<std::string*> targets;
+			};
+			std::array<Layer, 4> layers;
 
-					result.push_back(clone_underlabel);
-					result.push_back(clone_text);
+			size_t route_points = 0;
+			for (size_t i = 0; i < buses.size(); ++i) {
+				route_points += bus_fragments[i]->points.size();
+				layers[0].targets.push_back(&bus_fragments[i]->line);
+				layers[1].targets.push_back(&bus_fragments[i]->labels);
+			}
+			for (size_t i = 0; i < stops.size(); ++i) {
+				layers[2].targets.push_back(&stop_fragments[i]->icon);
+				layers[3].targets.push_back(&stop_fragments[i]->label);
+			}
+			layers[0].doc.Reserve(0, 0, buses.size(), route_points);
+			layers[1].doc.Reserve(0, 4 * buses.size(), 0, 0);
+			layers[2].doc.Reserve(stops.size(), 0, 0, 0);
+			layers[3].doc.Reserve(0, 2 * stops.size(), 0, 0);
+
+			const auto build = [](Layer& layer, auto&& add_fragment) {
+				layer.offsets.reserve(layer.targets.size() + 1);
+				layer.offsets.push_back(0u);
+				for (size_t i = 0; i < layer.targets.size(); ++i) {
+					add_fragment(layer.doc, i);
+					layer.offsets.push_back(layer.doc.GetSize());
 				}
+			};
+			const auto build_route_lines = [&] {
+				build(layers[0], [&](svg::Document& doc, size_t i) { RenderPolyline(doc, buses[i], positions); });
+			};
+			const auto build_bus_labels = [&] {
+				build(layers[1], [&](svg::Document& doc, size_t i) { AddBusnameLabels(doc, buses.subspan(i, 1), positions, nullptr); });
+			};
+			const auto build_stop_icons = [&] {
+				build(layers[2], [&](svg::Document& doc, size_t i) { AddStopIcons(doc, stops.subspan(i, 1), positions); });
+			};
+			const auto build_stop_labels = [&] {
+				build(layers[3], [&](svg::Document& doc, size_t i) { AddStopnameLabels(doc, stops.subspan(i, 1), positions); });
+			};
+
+			// Выводит фрагменты с номерами [first, last) в сквозной нумерации всех слоёв по порядку
+			const auto render = [&layers](size_t first, size_t last) {
+				for (const Layer& layer : layers) {
+					const size_t size = layer.targets.size();
+					for (size_t i = first; i < std::min(last, size); ++i) {
+						layer.targets[i]->clear();
+						layer.doc.RenderItems(*layer.targets[i], layer.offsets[i], layer.offsets[i + 1]);
+					}
+					first = first > size ? first - size : 0;
+					last = last > size ? last - size : 0;
+				}
+			};
 
+			const size_t threads = std::thread::hardware_concurrency();
+			if (threads < 2 || 5 * buses.size() + 3 * stops.size() < parallel_min_shapes) {
+				build_route_lines();
+				build_bus_labels();
+				build_stop_icons();
+				build_stop_labels();
+				render(0, buses.size() * 2 + stops.size() * 2);
+				return;
 			}
 
-			return result;
+			// Слои не зависят друг от друга, поэтому собираются одновременно
+			{
+				auto route_lines = RunAsync(build_route_lines);
+				auto bus_labels = RunAsync(build_bus_labels);
+				auto stop_icons = RunAsync(build_stop_icons);
+				build_stop_labels();
+				Wait(route_lines);
+				Wait(bus_labels);
+				Wait(stop_icons);
+			}
+
+			// Фрагменты всех слоёв делятся на отрезки поровну между задачами; каждый фрагмент выводится в свой буфер.
+			// Последний отрезок выводит вызывающий поток
+			const size_t fragments = buses.size() * 2 + stops.size() * 2;
+			const size_t task_count = std::min({ threads, parallel_max_tasks, (fragments + parallel_min_part - 1) / parallel_min_part });
+			const size_t part_size = (fragments + task_count - 1) / task_count;
+
+			std::vector<std::future<void>> tasks;
+			tasks.reserve(task_count - 1);
+			for (size_t first = 0; first + part_size < fragments; first += part_size) {
+				tasks.push_back(RunAsync([&render, first, part_size] { render(first, first + part_size); }));
+			}
+			render(tasks.size() * part_size, fragments);
+			for (auto& task : tasks) {
+				Wait(task);
+			}
 		}
 
-		std::vector<svg::Circle> MapRenderer::GetStopIcons(const std::map<std::string_view, const domain::Stop*>& stops, const SphereProjector& sp) const {
-			std::vector<svg::Circle> result;
+		std::string MapRenderer::RenderFragmentsText(const Layout& layout, TextCache& cache) const {
+			const StopPositions positions(layout.projector, layout.stop_positions);
+
+			// Фрагменты прошлой карты переносятся в новые таблицы по именам; то, что осталось в старых, исчезло с карты.
+			// Фрагмент устарел, если у маршрута изменились вершины линии, точки подписей или цвет, а у остановки — положение
+			std::unordered_map<std::string, BusFragment> buses;
+			buses.reserve(layout.buses.size());
+			std::vector<BusFragment*> bus_fragments;
+			bus_fragments.reserve(layout.buses.size());
+			std::vector<DrawnBus> stale_buses;
+			std::vector<BusFragment*> stale_bus_fragments;
+
+			std::vector<svg::Point> points;
+			std::vector<svg::Point> terminals;
+			for (const DrawnBus& drawn : layout.buses) {
+				const domain::Bus& bus = *drawn.bus;
+
+				points.clear();
+				if (drawn.lod) {
+					for (uint32_t i = drawn.lod->offsets[bus.id_]; i < drawn.lod->offsets[bus.id_ + 1]; ++i) {
+						points.push_back(positions(bus.GetRouteStop(drawn.lod->points[i])));
+					}
+				}
+				else {
+					for (const domain::Stop* stop : bus.GetRoute()) {
+						points.push_back(positions(stop));
+					}
+				}
 
-			for (const auto& [stop_name, stop] : stops) {
-				svg::Circle icon;
+				terminals.clear();
+				terminals.push_back(positions(bus.stops_[0]));
+				if (bus.is_circular_ == false && bus.stops_[0] != bus.GetLastStop()) {
+					terminals.push_back(positions(bus.GetLastStop()));
+				}
 
-				icon.SetCenter(sp(stop->coordinate_));
-				icon.SetRadius(settings_.stop_radius);
-				icon.SetFillColor("white");
+				std::string name(bus.name_);
+				auto node = cache.buses.extract(name);
+				BusFragment& fragment = node.empty()
+					? buses.try_emplace(std::move(name)).first->second
+					: buses.insert(std::move(node)).position->second;
+
+				if (fragment.line.empty() || fragment.color != drawn.color
+					|| fragment.points != points || fragment.terminals != terminals) {
+					fragment.color = drawn.color;
+					fragment.points.swap(points);
+					fragment.terminals.swap(terminals);
+					stale_buses.push_back(drawn);
+					stale_bus_fragments.push_back(&fragment);
+				}
+				bus_fragments.push_back(&fragment);
+			}
 
-				result.push_back(icon);
+			std::unordered_map<std::string, StopFragment> stops;
+			stops.reserve(layout.stops.size());
+			std::vector<StopFragment*> stop_fragments;
+			stop_fragments.reserve(layout.stops.size());
+			std::vector<const domain::Stop*> stale_stops;
+			std::vector<StopFragment*> stale_stop_fragments;
+
+			for (const domain::Stop* stop : layout.stops) {
+				const svg::Point position = positions(stop);
+
+				std::string name(stop->name_);
+				auto node = cache.stops.extract(name);
+				StopFragment& fragment = node.empty()
+					? stops.try_emplace(std::move(name)).first->second
+					: stops.insert(std::move(node)).position->second;
+
+				if (fragment.icon.empty() || fragment.position != position) {
+					fragment.position = position;
+					stale_stops.push_back(stop);
+					stale_stop_fragments.push_back(&fragment);
+				}
+				stop_fragments.push_back(&fragment);
 			}
 
-			return result;
-		}
+			RenderFragments(stale_buses, stale_bus_fragments, stale_stops, stale_stop_fragments, positions);
 
-		svg::Text MapRenderer::FillStopnameText(const domain::Stop* stop, const SphereProjector& sp) const {
-			svg::Text text;
-			
-			text.SetPosition(sp(stop->coordinate_));
-			text.SetOffset(settings_.stop_label_offset);
-			text.SetFontSize(settings_.stop_label_font_size);
-			text.SetFontFamily("Verdana");
-			text.SetData(stop->name_);
-			text.SetFillColor("black");
+			size_t text_size = 0;
+			for (const BusFragment* fragment : bus_fragments) {
+				text_size += fragment->line.size() + fragment->labels.size();
+			}
+			for (const StopFragment* fragment : stop_fragments) {
+				text_size += fragment->icon.size() + fragment->label.size();
+			}
+
+			// Порядок слоёв тот же, что в RenderLayers
+			std::string text;
+			text.reserve(text_size + 128);
+			svg::Document::RenderBegin(text);
+			for (const BusFragment* fragment : bus_fragments) {
+				text.append(fragment->line);
+			}
+			for (const BusFragment* fragment : bus_fragments) {
+				text.append(fragment->labels);
+			}
+			for (const StopFragment* fragment : stop_fragments) {
+				text.append(fragment->icon);
+			}
+			for (const StopFragment* fragment : stop_fragments) {
+				text.append(fragment->label);
+			}
+			svg::Document::RenderEnd(text);
 
+			cache.buses = std::move(buses);
+			cache.stops = std::move(stops);
 			return text;
 		}
-		svg::Text MapRenderer::FillStopnameUnderlabel(const domain::Stop* stop, const SphereProjector& sp) const {
 
-			svg::Text underlabel;
+		svg::Document MapRenderer::RenderSVG(const CatalogueSnapshot& catalogue) const {
+			svg::Document result_doc;
+			const auto layout = GetLayout(catalogue);
+			RenderLayers(result_doc, layout->buses, layout->stops, StopPositions(layout->projector, layout->stop_positions), nullptr);
+			return result_doc;
+		}
 
-			underlabel.SetPosition(sp(stop->coordinate_));
-			underlabel.SetOffset(settings_.stop_label_offset);
-			underlabel.SetFontSize(settings_.stop_label_font_size);
-			underlabel.SetFontFamily("Verdana");
-			underlabel.SetData(stop->name_);
-			underlabel.SetFillColor(settings_.underlayer_color);
-			underlabel.SetStrokeColor(settings_.underlayer_color);
-			underlabel.SetStrokeWidth(settings_.underlayer_width);
-			underlabel.SetStrokeLineCap(svg::StrokeLineCap::ROUND);
-			underlabel.SetStrokeLineJoin(svg::StrokeLineJoin::ROUND);
+		svg::Document MapRenderer::RenderViewport(const CatalogueSnapshot& catalogue, const geo::BoundingBox& viewport) const {
+			return RenderArea(catalogue, viewport,
+				SphereProjector::FromArea(viewport, settings_.width, settings_.height, settings_.padding));
+		}
 
-			return underlabel;
+		svg::Document MapRenderer::RenderTile(const CatalogueSnapshot& catalogue, const geo::BoundingBox& tile) const {
+			return RenderArea(catalogue, tile,
+				SphereProjector::FromTile(tile, settings_.width, settings_.height, settings_.padding));
 		}
 
-		std::vector<svg::Text> MapRenderer::GetStopnameLabels(const std::map<std::string_view, const domain::Stop*>& stops, const SphereProjector& sp) const {
-			std::vector<svg::Text> result;
+		// Отбор ограничен самой областью, а не всем изображением с полями: иначе на тайл попадали бы
+		// остановки и подписи соседних тайлов. Маршруты, пересекающие область, рисуются целиком
+		svg::Document MapRenderer::RenderArea(const CatalogueSnapshot& catalogue, const geo::BoundingBox& area,
+			const SphereProjector& sp) const {
 
-			for (const auto& [stop_name, stop] : stops) {
-				svg::Text text = FillStopnameText(stop, sp);
+			svg::Document result_doc;
 
-				svg::Text underlabel = FillStopnameUnderlabel(stop, sp);
+			const auto layout = GetLayout(catalogue);
+			const LodLevel* lod = ChooseLod(layout.get(), sp.GetZoom());
+			std::vector<DrawnBus> buses;
+			for (const uint32_t id : catalogue.GetRoutesIndex().FindOwners(area)) {
+				buses.push_back({ &catalogue.GetBusById(id), layout->bus_ranks[id] % settings_.color_palette.size(), lod });
+			}
 
-				result.push_back(underlabel);
-				result.push_back(text);
+			std::vector<const domain::Stop*> stops;
+			for (const uint32_t id : catalogue.GetStopsIndex().FindInBox(area)) {
+				const domain::Stop& stop = catalogue.GetStopById(id);
+				if (!catalogue.GetBusesByStop(&stop).empty()) {
+					stops.push_back(&stop);
+				}
 			}
 
-			return result;
+			RenderLayers(result_doc, buses, stops, StopPositions(sp), &area);
+
+			return result_doc;
 		}
 
-		svg::Document MapRenderer::RenderSVG(const std::map<std::string_view, domain::Bus*> busname_to_bus) const {
+		svg::Document MapRenderer::RenderRoute(const CatalogueSnapshot& catalogue, std::span<const RouteRide> rides) const {
 			svg::Document result_doc;
-			std::unordered_set<geo::Coordinates, geo::CoordinateHasher> stops_coords;
-			std::map<std::string_view, const domain::Stop*> all_stops;
 
-			for(const auto& [busname, bus] : busname_to_bus){
+			const auto layout = GetLayout(catalogue);
+			const StopPositions positions(layout->projector, layout->stop_positions);
 
-				if (bus->stops_.empty()) {
-					continue;
+			std::vector<const domain::Stop*> stops;
+			for (const RouteRide& ride : rides) {
+				for (size_t i = ride.first; i <= ride.last; ++i) {
+					stops.push_back(ride.bus->GetRouteStop(i));
 				}
+			}
+			const size_t route_points = stops.size();
+
+			// Остановки выводятся, как на полной карте, по имени, то есть по id, и без повторов
+			std::sort(stops.begin(), stops.end(), [](const domain::Stop* lhs, const domain::Stop* rhs) {
+				return lhs->id_ < rhs->id_;
+			});
+			stops.erase(std::unique(stops.begin(), stops.end()), stops.end());
+
+			result_doc.Reserve(stops.size(), 4 * rides.size() + 2 * stops.size(), rides.size(), route_points);
 
-				for (const auto& stop : bus->stops_) {
-					stops_coords.insert(stop->coordinate_);
-					all_stops[stop->name_] = stop;
+			for (const RouteRide& ride : rides) {
+				StartRouteLine(result_doc, layout->bus_ranks[ride.bus->id_] % settings_.color_palette.size());
+				for (size_t i = ride.first; i <= ride.last; ++i) {
+					result_doc.AddPolylinePoint(positions(ride.bus->GetRouteStop(i)));
 				}
 			}
 
-			SphereProjector sp(std::begin(stops_coords), std::end(stops_coords),
-				settings_.width, settings_.height, settings_.padding);
+			for (const RouteRide& ride : rides) {
+				const size_t color = layout->bus_ranks[ride.bus->id_] % settings_.color_palette.size();
+				for (const size_t i : { ride.first, ride.last }) {
+					const svg::Point position = positions(ride.bus->GetRouteStop(i));
+					FillBusnameUnderlabel(result_doc.AddText(), *ride.bus, position);
+					FillBusnameText(result_doc.AddText(), *ride.bus, color, position);
+				}
+			}
+
+			AddStopIcons(result_doc, stops, positions);
+			AddStopnameLabels(result_doc, stops, positions);
+
+			return result_doc;
+		}
+
+		const MapRenderer::LodLevel* MapRenderer::ChooseLod(const Layout* layout, double zoom) const {
+			if (!layout || settings_.simplify_tolerance <= 0.0 || IsZero(zoom)) {
+				return nullptr;
+			}
 
-			for (const auto& line : GetRouteLines(busname_to_bus, sp)) {
-				result_doc.Add(line);
+			const double allowed = settings_.simplify_tolerance / zoom;
+			const LodLevel* result = nullptr;
+			for (const LodLevel& level : layout->lod_levels) {
+				if (level.tolerance > allowed) {
+					break;
+				}
+				result = &level;
 			}
+			return result;
+		}
 
-			for (const auto& text : GetBusnameLabels(busname_to_bus, sp)) {
-				result_doc.Add(text);
+		void MapRenderer::BuildLodLevels(std::span<const domain::Bus> buses, std::vector<LodLevel>& levels) {
+			levels.resize(lod_level_count);
+
+			std::vector<geo::Coordinates> route;
+			double tolerance = lod_base_tolerance;
+			for (LodLevel& level : levels) {
+				level.tolerance = tolerance;
+				level.offsets.reserve(buses.size() + 1);
+				level.offsets.push_back(0u);
+
+				for (const auto& bus : buses) {
+					route.clear();
+					for (const domain::Stop* stop : bus.GetRoute()) {
+						route.push_back(stop->coordinate_);
+					}
+					const std::vector<uint32_t> kept = geo::SimplifyPolyline(route, tolerance);
+					level.points.insert(level.points.end(), kept.begin(), kept.end());
+					level.offsets.push_back(static_cast<uint32_t>(level.points.size()));
+				}
+				tolerance *= lod_level_factor;
 			}
+		}
 
-			for (const auto& circle : GetStopIcons(all_stops, sp)) {
-				result_doc.Add(circle);
+		std::shared_ptr<const MapRenderer::Layout> MapRenderer::GetLayout(const CatalogueSnapshot& catalogue) const {
+			std::lock_guard lock(layout_cache_->mutex);
+			if (layout_cache_->layout && layout_cache_->layout->catalogue_version == catalogue.GetVersion()) {
+				return layout_cache_->layout;
 			}
-			for (const auto& text : GetStopnameLabels(all_stops, sp)) {
-				result_doc.Add(text);
+
+			auto layout = std::make_shared<Layout>();
+			layout->catalogue_version = catalogue.GetVersion();
+
+			// Остановки снимка уже упорядочены по имени, на карту попадают только те, через которые идут маршруты
+			std::vector<geo::Coordinates> stops_coords;
+			for (const auto& stop : catalogue.GetAllStops()) {
+				if (!catalogue.GetBusesByStop(&stop).empty()) {
+					layout->stops.push_back(&stop);
+					stops_coords.push_back(stop.coordinate_);
+				}
 			}
+			layout->projector = SphereProjector(std::begin(stops_coords), std::end(stops_coords),
+				settings_.width, settings_.height, settings_.padding);
 
-			return result_doc;
+			// Маршруты проходят только через остановки карты, так что положения остальных не понадобятся
+			layout->stop_positions.resize(catalogue.GetAllStops().size());
+			for (const domain::Stop* stop : layout->stops) {
+				layout->stop_positions[stop->id_] = layout->projector(stop->coordinate_);
+			}
+
+			const auto buses = catalogue.GetAllBuses();
+			if (settings_.simplify_tolerance > 0.0) {
+				BuildLodLevels(buses, layout->lod_levels);
+			}
+			const LodLevel* lod = ChooseLod(layout.get(), layout->projector.GetZoom());
+
+			// Цвета палитры раздаются по кругу маршрутам с остановками в порядке имён
+			layout->bus_ranks.reserve(buses.size());
+			uint32_t rank = 0;
+			for (const auto& bus : buses) {
+				layout->bus_ranks.push_back(rank);
+				if (!bus.stops_.empty()) {
+					layout->buses.push_back({ &bus, rank % settings_.color_palette.size(), lod });
+					++rank;
+				}
+			}
+
+			layout_cache_->layout = std::move(layout);
+			return layout_cache_->layout;
+		}
+
+		// Отрисовка идёт под блокировкой, чтобы одновременные запросы к новой версии не рисовали карту каждый сам
+		std::shared_ptr<const std::string> MapRenderer::RenderSVGText(const CatalogueSnapshot& catalogue) const {
+			std::lock_guard lock(text_cache_->mutex);
+			if (!text_cache_->text || text_cache_->catalogue_version != catalogue.GetVersion()) {
+				const auto layout = GetLayout(catalogue);
+				text_cache_->text = std::make_shared<const std::string>(RenderFragmentsText(*layout, *text_cache_));
+				text_cache_->catalogue_version = catalogue.GetVersion();
+			}
+			return text_cache_->text;
 		}
 
 	} // renderer namespace
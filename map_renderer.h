@@ -9,13 +9,18 @@
 #include "domain.h"
 #include "geo.h"
 #include "svg.h"
+#include "transport_catalogue.h"
 
 #include <algorithm>
+#include <cstdint>
 #include <cstdlib>
 #include <iostream>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <optional>
+#include <span>
+#include <string>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -28,6 +33,8 @@ namespace transport {
 
         class SphereProjector {
         public:
+            SphereProjector() = default;
+
             // points_begin и points_end задают начало и конец интервала элементов geo::Coordinates
             template <typename PointInputIt>
             SphereProjector(PointInputIt points_begin, PointInputIt points_end,
@@ -83,11 +90,26 @@ namespace transport {
             // Проецирует широту и долготу в координаты внутри SVG-изображения
             svg::Point operator()(geo::Coordinates coords) const;
 
+            // Проекция, вписывающая прямоугольник area в изображение с одним масштабом по обеим осям
+            static SphereProjector FromArea(const geo::BoundingBox& area, double max_width, double max_height, double padding);
+
+            // Проекция Web Mercator, растягивающая тайл на всё изображение за вычетом отступа padding:
+            // масштабы по осям подбираются независимо, так что тайл заполняет изображение без полей
+            static SphereProjector FromTile(const geo::BoundingBox& tile, double width, double height, double padding);
+
+            // Масштаб по горизонтали: пикселей на градус долготы
+            double GetZoom() const;
+
         private:
-            double padding_;
+            double padding_ = 0;
             double min_lon_ = 0;
+            // У проекции Web Mercator здесь хранится не широта, а её ордината MercatorY
             double max_lat_ = 0;
             double zoom_coeff_ = 0;
+
+            // Проекция Web Mercator с отдельным масштабом по вертикали
+            bool mercator_ = false;
+            double height_zoom_ = 0;
         };
 
         struct RendererSettings {
@@ -109,6 +131,16 @@ namespace transport {
             double underlayer_width = 0.0;
 
             std::vector<svg::Color> color_palette;
+
+            // Допустимое отклонение упрощённых линий маршрутов в пикселях. При нуле линии не упрощаются
+            double simplify_tolerance = 0.0;
+        };
+
+        // Участок поездки по маршруту bus: позиции first < last в полной последовательности его остановок
+        struct RouteRide {
+            const domain::Bus* bus = nullptr;
+            size_t first = 0;
+            size_t last = 0;
         };
 
         class RouteLine : public svg::Drawable {
@@ -129,25 +161,158 @@ namespace transport {
             MapRenderer() = default;
             MapRenderer(const RendererSettings& render_settings);
 
-            svg::Document RenderSVG(const std::map<std::string_view, domain::Bus*> busname_to_bus) const;
+            svg::Document RenderSVG(const CatalogueSnapshot& catalogue) const;
+
+            // Отрисовывает часть карты в пределах viewport, растянутую на всё изображение с отступом padding.
+            // Маршруты и остановки отбираются по пространственным индексам справочника, так что объём работы
+            // зависит от видимой части сети. Цвета маршрутов совпадают с цветами на полной карте
+            svg::Document RenderViewport(const CatalogueSnapshot& catalogue, const geo::BoundingBox& viewport) const;
 
+            // Отрисовывает тайл с границами tile в проекции Web Mercator, растянутый на всё изображение.
+            // Отбор маршрутов и остановок тот же, что у RenderViewport
+            svg::Document RenderTile(const CatalogueSnapshot& catalogue, const geo::BoundingBox& tile) const;
+
+            // Текст карты в формате SVG. Последний результат запоминается вместе с версией справочника,
+            // так что повторный запрос к той же версии не перерисовывает карту.
+            // Для новой версии справочника заново выводятся только маршруты и остановки, у которых изменились
+            // вершины, точки подписей или цвет, остальной текст собирается из фрагментов прошлой карты
+            std::shared_ptr<const std::string> RenderSVGText(const CatalogueSnapshot& catalogue) const;
+
+            // Только участки поездки rides и пройденные ими остановки. Проекция и цвета маршрутов те же, что на полной карте,
+            // так что изображение совмещается с ней. Названия маршрутов подписываются у остановок посадки и высадки
+            svg::Document RenderRoute(const CatalogueSnapshot& catalogue, std::span<const RouteRide> rides) const;
 
         private:
+            // Текст линии и подписей маршрута на карте и данные, от которых он зависит
+            struct BusFragment {
+                size_t color = 0;
+                std::vector<svg::Point> points;
+                std::vector<svg::Point> terminals;
+                std::string line;
+                std::string labels;
+            };
+
+            // Текст значка и подписи остановки на карте
+            struct StopFragment {
+                svg::Point position;
+                std::string icon;
+                std::string label;
+            };
+
+            struct TextCache {
+                std::mutex mutex;
+                uint64_t catalogue_version = 0;
+                std::shared_ptr<const std::string> text;
+                // Фрагменты последней карты по именам маршрутов и остановок
+                std::unordered_map<std::string, BusFragment> buses;
+                std::unordered_map<std::string, StopFragment> stops;
+            };
+
+            // Линии маршрутов, упрощённые с допуском tolerance градусов: номера оставленных вершин полной
+            // последовательности остановок маршрута id лежат в points на отрезке [offsets[id], offsets[id + 1])
+            struct LodLevel {
+                double tolerance = 0.0;
+                std::vector<uint32_t> offsets;
+                std::vector<uint32_t> points;
+            };
+
+            // Маршрут, попадающий на карту, и номер его цвета в палитре
+            // Если задан уровень lod, линия маршрута проводится только через оставленные им вершины
+            struct DrawnBus {
+                const domain::Bus* bus = nullptr;
+                size_t color = 0;
+                const LodLevel* lod = nullptr;
+            };
+
+            // Данные полной карты, зависящие только от версии справочника: вычисляются один раз на версию.
+            // Уровни упрощения, на которые ссылаются buses, принадлежат тому же объекту
+            struct Layout {
+                uint64_t catalogue_version = 0;
+                // Порядковый номер маршрута среди маршрутов с остановками: по нему выбирается цвет палитры
+                std::vector<uint32_t> bus_ranks;
+                // Уровни упрощения линий по возрастанию допуска; строятся, только если упрощение включено
+                std::vector<LodLevel> lod_levels;
+                // Проекция полной карты и положения на изображении всех остановок в порядке их id
+                SphereProjector projector;
+                std::vector<svg::Point> stop_positions;
+                // Маршруты и остановки полной карты в порядке вывода
+                std::vector<DrawnBus> buses;
+                std::vector<const domain::Stop*> stops;
+            };
+
+            struct LayoutCache {
+                std::mutex mutex;
+                std::shared_ptr<const Layout> layout;
+            };
+
+            // Положение остановки на изображении: для полной карты берётся из заранее вычисленного массива
+            // по id остановки, для остальных проекций вычисляется на месте
+            class StopPositions {
+            public:
+                explicit StopPositions(const SphereProjector& sp, std::span<const svg::Point> positions = {}) :
+                    sp_(sp), positions_(positions) {
+                }
 
-            svg::Polyline RenderPolyline(std::vector<const domain::Stop*> route_stops, size_t& color_count, const SphereProjector& sp) const;
+                svg::Point operator()(const domain::Stop* stop) const {
+                    return positions_.empty() ? sp_(stop->coordinate_) : positions_[stop->id_];
+                }
+
+            private:
+                const SphereProjector& sp_;
+                std::span<const svg::Point> positions_;
+            };
+
+            std::shared_ptr<const Layout> GetLayout(const CatalogueSnapshot& catalogue) const;
+
+            // Упрощает линии всех маршрутов с допусками от 1e-5 градуса (около метра), каждый следующий вчетверо грубее
+            static void BuildLodLevels(std::span<const domain::Bus> buses, std::vector<LodLevel>& levels);
+
+            // Самый грубый уровень, отклонение которого при масштабе zoom не превышает simplify_tolerance пикселей.
+            // Возвращает nullptr, если упрощение выключено или не подходит ни один уровень
+            const LodLevel* ChooseLod(const Layout* layout, double zoom) const;
+
+            // Добавляет в документ пустую линию маршрута цвета color
+            void StartRouteLine(svg::Document& doc, size_t color) const;
 
-            svg::Text FillBusnameText(const domain::Bus* bus, const size_t& color_count, const SphereProjector& sp) const;
-            svg::Text FillBusnameUnderlabel(const domain::Bus* bus, const SphereProjector& sp) const;
+            // Рисует маршруты и остановки, попадающие в area, в проекции sp
+            svg::Document RenderArea(const CatalogueSnapshot& catalogue, const geo::BoundingBox& area, const SphereProjector& sp) const;
 
-            svg::Text FillStopnameText(const domain::Stop* stop, const SphereProjector& sp) const;
-            svg::Text FillStopnameUnderlabel(const domain::Stop* stop, const SphereProjector& sp) const;
+            // Фигуры создаются прямо в документе, вершины ломаных пишутся в его общий буфер точек
+            void RenderPolyline(svg::Document& doc, const DrawnBus& drawn, const StopPositions& positions) const;
 
-            std::vector<svg::Polyline> GetRouteLines(const std::map<std::string_view, domain::Bus*>& buses, const SphereProjector& sp) const;
-            std::vector<svg::Text> GetBusnameLabels(const std::map<std::string_view, domain::Bus*>& buses, const SphereProjector& sp) const;
-            std::vector<svg::Circle> GetStopIcons(const std::map<std::string_view, const domain::Stop*>& stops, const SphereProjector& sp) const;
-            std::vector<svg::Text> GetStopnameLabels(const std::map<std::string_view, const domain::Stop*>& stops, const SphereProjector& sp) const;
+            void FillBusnameText(svg::Text& text, const domain::Bus& bus, size_t color_count, svg::Point position) const;
+            void FillBusnameUnderlabel(svg::Text& underlabel, const domain::Bus& bus, svg::Point position) const;
+
+            void FillStopnameText(svg::Text& text, const domain::Stop& stop, svg::Point position) const;
+            void FillStopnameUnderlabel(svg::Text& underlabel, const domain::Stop& stop, svg::Point position) const;
+
+            // Заполняет документ слоями карты в порядке: линии маршрутов, названия маршрутов, остановки, названия остановок.
+            // Если задана область area, названия маршрутов выводятся только у конечных, лежащих внутри неё
+            void RenderLayers(svg::Document& doc, std::span<const DrawnBus> buses, std::span<const domain::Stop* const> stops,
+                const StopPositions& positions, const geo::BoundingBox* area) const;
+
+            // Текст полной карты из фрагментов cache: устаревшие фрагменты выводятся заново, фрагменты исчезнувших
+            // маршрутов и остановок удаляются. Для большого числа устаревших фрагментов слои собираются одновременно,
+            // а их элементы выводятся параллельно отрезками
+            std::string RenderFragmentsText(const Layout& layout, TextCache& cache) const;
+
+            // Выводит фрагменты маршрутов buses и остановок stops в их текстовые поля
+            void RenderFragments(std::span<const DrawnBus> buses, std::span<BusFragment* const> bus_fragments,
+                std::span<const domain::Stop* const> stops, std::span<StopFragment* const> stop_fragments,
+                const StopPositions& positions) const;
+
+            void AddRouteLines(svg::Document& doc, std::span<const DrawnBus> buses, const StopPositions& positions) const;
+            void AddBusnameLabels(svg::Document& doc, std::span<const DrawnBus> buses, const StopPositions& positions,
+                const geo::BoundingBox* area) const;
+            void AddStopIcons(svg::Document& doc, std::span<const domain::Stop* const> stops, const StopPositions& positions) const;
+            void AddStopnameLabels(svg::Document& doc, std::span<const domain::Stop* const> stops, const StopPositions& positions) const;
 
             RendererSettings settings_;
+
+            // Копии визуализатора делят один кеш. Настройки задаются только при создании визуализатора и у копий
+            // совпадают, поэтому ключом кеша служит одна версия справочника
+            std::shared_ptr<TextCache> text_cache_ = std::make_shared<TextCache>();
+            std::shared_ptr<LayoutCache> layout_cache_ = std::make_shared<LayoutCache>();
         };
 	}
 }
\ No newline at end of file
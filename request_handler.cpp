@@ -2,8 +2,8 @@
 
 namespace transport {
 
-	RequestHandler::RequestHandler(const TransportCatalogue& db, const renderer::MapRenderer& renderer, const TransportRouter& tr) :
-		db_(db), renderer_(renderer), tr_(tr) {
+	RequestHandler::RequestHandler(std::shared_ptr<const CatalogueVersion> version, const renderer::MapRenderer& renderer) :
+		version_(std::move(version)), db_(version_->catalogue), renderer_(renderer), tr_(version_->router) {
 	}
 
 	std::optional<domain::BusInfo> RequestHandler::GetBusStat(const std::string_view& bus_name) const {
@@ -12,25 +12,83 @@ namespace transport {
 			return std::nullopt;
 		}
 
-		auto bus_stat = db_.GetBusInfo(bus);
-		return bus_stat;
+		return db_.GetBusInfo(bus);
 	}
 
-	std::optional <const std::set<domain::Bus*, BusPtrHasher>*> RequestHandler::GetBusesByStop(const std::string_view& stop_name) const {
-		if (!db_.GetStop(stop_name)) {
+	std::optional<std::span<const BusId>> RequestHandler::GetBusesByStop(const std::string_view& stop_name) const {
+		auto stop = db_.GetStop(stop_name);
+		if (!stop) {
 			return std::nullopt;
 		}
 
-		auto buses_by_stop = &db_.GetBusesByStop(stop_name);
-		return buses_by_stop;
+		return db_.GetBusesByStop(stop);
+	}
+
+	const domain::Bus& RequestHandler::GetBusById(BusId id) const {
+		return db_.GetBusById(id);
+	}
+
+	const domain::Stop& RequestHandler::GetStopById(size_t id) const {
+		return db_.GetStopById(id);
+	}
+
+	std::vector<geo::Neighbour> RequestHandler::GetNearbyStops(geo::Coordinates center,
+		std::optional<double> radius, std::optional<size_t> count) const {
+
+		const geo::GridIndex& index = db_.GetStopsIndex();
+
+		if (!radius) {
+			return count ? index.FindNearest(center, *count) : std::vector<geo::Neighbour>{};
+		}
+
+		// Результат отсортирован по расстоянию, так что ближайшие count остановок стоят в начале
+		std::vector<geo::Neighbour> stops = index.FindWithinRadius(center, *radius);
+		if (count && stops.size() > *count) {
+			stops.resize(*count);
+		}
+		return stops;
 	}
 
 	svg::Document RequestHandler::RenderMap() const {
-		return renderer_.RenderSVG(db_.GetAllBuses());
+		return renderer_.RenderSVG(db_);
+	}
+
+	std::shared_ptr<const std::string> RequestHandler::RenderMapText() const {
+		return renderer_.RenderSVGText(db_);
+	}
+
+	svg::Document RequestHandler::RenderMapViewport(const geo::BoundingBox& viewport) const {
+		return renderer_.RenderViewport(db_, viewport);
+	}
+
+	svg::Document RequestHandler::RenderMapTile(const geo::BoundingBox& tile) const {
+		return renderer_.RenderTile(db_, tile);
 	}
 
 	const TransportRouter::TRInfo RequestHandler::GetRoute(const std::string& from, const std::string& to) const {
 		return tr_.FindRoute(from, to);
 	}
 
+	// Поездка по ребру графа проходит span перегонов от остановки посадки до остановки высадки.
+	// Обратное ребро некольцевого маршрута совпадает с участком обратного хода, так что поиск
+	// по полной последовательности остановок находит участок для рёбер обоих направлений
+	svg::Document RequestHandler::RenderRoute(const TransportRouter::TRInfo& route) const {
+		std::vector<renderer::RouteRide> rides;
+		for (const auto& edge : route.edges) {
+			if (edge.quality == 0) {
+				continue;
+			}
+			const domain::Bus* bus = db_.GetBus(edge.name);
+			const size_t from = TransportRouter::GetStopId(edge.from);
+			const size_t to = TransportRouter::GetStopId(edge.to);
+			for (size_t first = 0; bus && first + edge.quality < bus->GetRouteSize(); ++first) {
+				if (bus->GetRouteStop(first)->id_ == from && bus->GetRouteStop(first + edge.quality)->id_ == to) {
+					rides.push_back({ bus, first, first + edge.quality });
+					break;
+				}
+			}
+		}
+		return renderer_.RenderRoute(db_, rides);
+	}
+
 }
\ No newline at end of file
@@ -1,12 +1,15 @@
 #pragma once
 
+#include "catalogue_store.h"
 #include "map_renderer.h"
 #include "transport_catalogue.h"
 #include "transport_router.h"
 
-#include <map>
+#include <memory>
 #include <optional>
-#include <set>
+#include <span>
+#include <string>
+#include <vector>
 
 /*
  * Здесь можно было бы разместить код обработчика запросов к базе, содержащего логику, которую не
@@ -33,22 +36,45 @@ namespace transport {
 
     public:
 
-        RequestHandler(const TransportCatalogue& db, const renderer::MapRenderer& renderer, const TransportRouter& tr);
+        // Обработчик удерживает версию справочника, так что ответы остаются валидными до его уничтожения,
+        // даже если за это время была опубликована новая версия
+        RequestHandler(std::shared_ptr<const CatalogueVersion> version, const renderer::MapRenderer& renderer);
 
         // Возвращает информацию о маршруте (запрос Bus)
         std::optional<domain::BusInfo> GetBusStat(const std::string_view& bus_name) const;
 
         // Возвращает маршруты, проходящие через
-        std::optional < const std::set<domain::Bus*, BusPtrHasher>*> GetBusesByStop(const std::string_view& stop_name) const;
+        std::optional<std::span<const BusId>> GetBusesByStop(const std::string_view& stop_name) const;
+
+        const domain::Bus& GetBusById(BusId id) const;
+        const domain::Stop& GetStopById(size_t id) const;
+
+        // Возвращает остановки рядом с точкой (запрос NearbyStops) по возрастанию расстояния:
+        // не дальше radius метров, не больше count штук. Должно быть задано хотя бы одно ограничение
+        std::vector<geo::Neighbour> GetNearbyStops(geo::Coordinates center,
+            std::optional<double> radius, std::optional<size_t> count) const;
 
         // Этот метод будет нужен в следующей части итогового проекта
         svg::Document RenderMap() const;
 
+        // Текст карты в формате SVG; для одной версии справочника карта рисуется один раз
+        std::shared_ptr<const std::string> RenderMapText() const;
+
+        // Часть карты в пределах viewport, растянутая на всё изображение
+        svg::Document RenderMapViewport(const geo::BoundingBox& viewport) const;
+
+        // Тайл карты с границами tile в проекции Web Mercator
+        svg::Document RenderMapTile(const geo::BoundingBox& tile) const;
+
         const TransportRouter::TRInfo GetRoute(const std::string& from, const std::string& to) const;
 
+        // Остановки и участки маршрутов найденной поездки в проекции и цветах полной карты
+        svg::Document RenderRoute(const TransportRouter::TRInfo& route) const;
+
     private:
         // RequestHandler использует агрегацию объектов "Транспортный Справочник" и "Визуализатор Карты"
-        const TransportCatalogue& db_;
+        std::shared_ptr<const CatalogueVersion> version_;
+        const CatalogueSnapshot& db_;
         const renderer::MapRenderer& renderer_;
         const TransportRouter& tr_;
     };
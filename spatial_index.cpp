@@ -0,0 +1,376 @@
+#include "spatial_index.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace transport {
+    namespace geo {
+
+        namespace {
+            // Должны совпадать с константами ComputeDistance, чтобы границы поиска не отсекали подходящие точки
+            const double dr = 3.1415926535 / 180.;
+            const double earth_radius = 6371000.;
+
+            // Расстояние, которое заведомо больше любого расстояния между точками сферы
+            const double max_radius = 4 * earth_radius;
+
+            // Запас на погрешность округления при переводе радиуса поиска в градусы
+            const double bounds_margin = 1e-9;
+
+            // Наибольшее число ячеек сетки, в которые записывается один отрезок
+            const size_t max_segment_cells = 64;
+
+            // Число строк сетки из cells ячеек над областью height на width, при котором ячейки близки к квадратам
+            size_t ChooseRows(size_t cells, double height, double width) {
+                if (height <= 0. && width <= 0.) {
+                    return 1u;
+                }
+                if (width <= 0.) {
+                    return cells;
+                }
+                if (height <= 0.) {
+                    return 1u;
+                }
+                const double rows = std::round(std::sqrt(cells * height / width));
+                return static_cast<size_t>(std::clamp(rows, 1., static_cast<double>(cells)));
+            }
+        }
+
+        GridIndex::GridIndex(const allocator_type& alloc) :
+            cell_offsets_(alloc), ids_(alloc), positions_(alloc), points_(alloc) {}
+
+        void GridIndex::Build(std::span<const Coordinates> points) {
+            cell_offsets_.clear();
+            ids_.clear();
+            positions_.clear();
+            points_.Clear();
+            rows_ = columns_ = 0u;
+
+            if (points.empty()) {
+                return;
+            }
+
+            min_lat_ = max_lat_ = points.front().lat;
+            min_lng_ = max_lng_ = points.front().lng;
+            for (const Coordinates& point : points) {
+                min_lat_ = std::min(min_lat_, point.lat);
+                max_lat_ = std::max(max_lat_, point.lat);
+                min_lng_ = std::min(min_lng_, point.lng);
+                max_lng_ = std::max(max_lng_, point.lng);
+            }
+
+            // Соотношение строк и столбцов выбирается по размерам области в метрах, чтобы ячейки были близки к квадратам
+            const size_t cells = std::max<size_t>(1u, points.size() / 2);
+            const double height = max_lat_ - min_lat_;
+            const double width = (max_lng_ - min_lng_) * std::cos((min_lat_ + max_lat_) / 2 * dr);
+
+            rows_ = ChooseRows(cells, height, width);
+            columns_ = std::max<size_t>(1u, cells / rows_);
+
+            cell_lat_ = height > 0. ? height / rows_ : 1.;
+            cell_lng_ = max_lng_ > min_lng_ ? (max_lng_ - min_lng_) / columns_ : 1.;
+
+            // Сортировка подсчётом: первый проход считает точки ячеек, второй раскладывает id по отрезкам
+            std::vector<uint32_t> point_cell(points.size());
+            cell_offsets_.assign(rows_ * columns_ + 1, 0u);
+            for (size_t id = 0; id < points.size(); ++id) {
+                point_cell[id] = static_cast<uint32_t>(GetRow(points[id].lat) * columns_ + GetColumn(points[id].lng));
+                ++cell_offsets_[point_cell[id] + 1];
+            }
+            for (size_t i = 1; i < cell_offsets_.size(); ++i) {
+                cell_offsets_[i] += cell_offsets_[i - 1];
+            }
+
+            std::vector<uint32_t> cursor(cell_offsets_.begin(), cell_offsets_.end() - 1);
+            ids_.resize(points.size());
+            positions_.resize(points.size());
+            for (size_t id = 0; id < points.size(); ++id) {
+                positions_[id] = cursor[point_cell[id]]++;
+                ids_[positions_[id]] = static_cast<uint32_t>(id);
+            }
+
+            points_.Reserve(points.size());
+            for (const uint32_t id : ids_) {
+                points_.Add(points[id]);
+            }
+        }
+
+        std::vector<Neighbour> GridIndex::FindWithinRadius(Coordinates center, double radius) const {
+            std::vector<Neighbour> result;
+            if (ids_.empty() || !(radius >= 0.)) {
+                return result;
+            }
+
+            const double angle = radius / earth_radius * (1. + bounds_margin);
+            const double lat_delta = angle / dr + bounds_margin;
+            const double lat_from = center.lat - lat_delta;
+            const double lat_to = center.lat + lat_delta;
+
+            if (lat_to < min_lat_ || lat_from > max_lat_) {
+                return result;
+            }
+
+            // Разброс долгот точек круга поиска зависит от широты центра.
+            // Если круг захватывает полюс, подходят любые долготы
+            std::vector<std::pair<double, double>> lng_ranges;
+            const double lng_sin = lat_from <= -90. || lat_to >= 90. ? 1. : std::sin(angle) / std::cos(center.lat * dr);
+
+            if (angle >= 3.1415926535 / 2 || lng_sin >= 1.) {
+                lng_ranges.emplace_back(min_lng_, max_lng_);
+            }
+            else {
+                const double lng_delta = std::asin(lng_sin) / dr + bounds_margin;
+                const double lng_from = center.lng - lng_delta;
+                const double lng_to = center.lng + lng_delta;
+
+                // Круг, пересекающий линию перемены дат, даёт два диапазона долгот
+                if (lng_from < -180.) {
+                    lng_ranges.emplace_back(lng_from + 360., 180.);
+                    lng_ranges.emplace_back(-180., lng_to);
+                }
+                else if (lng_to > 180.) {
+                    lng_ranges.emplace_back(lng_from, 180.);
+                    lng_ranges.emplace_back(-180., lng_to - 360.);
+                }
+                else {
+                    lng_ranges.emplace_back(lng_from, lng_to);
+                }
+            }
+
+            // Диапазоны долгот переводятся в диапазоны столбцов; пересекающиеся объединяются, чтобы точки не повторялись
+            std::vector<std::pair<size_t, size_t>> columns;
+            for (const auto& [from, to] : lng_ranges) {
+                if (to >= min_lng_ && from <= max_lng_) {
+                    columns.emplace_back(GetColumn(from), GetColumn(to));
+                }
+            }
+            std::sort(columns.begin(), columns.end());
+            if (columns.size() == 2 && columns[1].first <= columns[0].second) {
+                columns[0].second = std::max(columns[0].second, columns[1].second);
+                columns.pop_back();
+            }
+
+            for (const auto& [col_from, col_to] : columns) {
+                CollectCells(center, radius, GetRow(lat_from), GetRow(lat_to), col_from, col_to, result);
+            }
+
+            std::sort(result.begin(), result.end(), [](const Neighbour& lhs, const Neighbour& rhs) {
+                return lhs.distance != rhs.distance ? lhs.distance < rhs.distance : lhs.id < rhs.id;
+            });
+            return result;
+        }
+
+        std::vector<Neighbour> GridIndex::FindNearest(Coordinates center, size_t count) const {
+            count = std::min(count, ids_.size());
+            if (count == 0u) {
+                return {};
+            }
+
+            // Поиск по кругу, радиус которого удваивается, пока в него не попадёт count точек.
+            // Все точки внутри круга найдены, поэтому первые count из них и есть ближайшие.
+            // Начальный радиус рассчитан на то, чтобы при равномерном распределении хватило одного шага
+            double radius = std::max(cell_lat_, cell_lng_) * dr * earth_radius * std::sqrt(static_cast<double>(count));
+            if (!(radius > 0.)) {
+                radius = 1.;
+            }
+
+            while (true) {
+                std::vector<Neighbour> result = FindWithinRadius(center, radius);
+                if (result.size() >= count || radius >= max_radius) {
+                    result.resize(std::min(result.size(), count));
+                    return result;
+                }
+                radius *= 2;
+            }
+        }
+
+        std::vector<uint32_t> GridIndex::FindInBox(const BoundingBox& box) const {
+            std::vector<uint32_t> result;
+            if (ids_.empty() || !box.IsValid()
+                || box.max_lat < min_lat_ || box.min_lat > max_lat_ || box.max_lng < min_lng_ || box.min_lng > max_lng_) {
+                return result;
+            }
+
+            const size_t col_from = GetColumn(box.min_lng);
+            const size_t col_to = GetColumn(box.max_lng);
+            const CoordinatesSoA points = points_.View();
+            for (size_t row = GetRow(box.min_lat); row <= GetRow(box.max_lat); ++row) {
+                const uint32_t begin = cell_offsets_[row * columns_ + col_from];
+                const uint32_t end = cell_offsets_[row * columns_ + col_to + 1];
+                for (uint32_t i = begin; i < end; ++i) {
+                    if (box.Contains({ points.lat[i], points.lng[i] })) {
+                        result.push_back(ids_[i]);
+                    }
+                }
+            }
+
+            std::sort(result.begin(), result.end());
+            return result;
+        }
+
+        const CoordinatesTable& GridIndex::GetPoints() const {
+            return points_;
+        }
+
+        uint32_t GridIndex::GetPosition(uint32_t id) const {
+            return positions_[id];
+        }
+
+        size_t GridIndex::GetRow(double lat) const {
+            if (!(lat > min_lat_)) {
+                return 0u;
+            }
+            return std::min(static_cast<size_t>((lat - min_lat_) / cell_lat_), rows_ - 1);
+        }
+
+        size_t GridIndex::GetColumn(double lng) const {
+            if (!(lng > min_lng_)) {
+                return 0u;
+            }
+            return std::min(static_cast<size_t>((lng - min_lng_) / cell_lng_), columns_ - 1);
+        }
+
+        void GridIndex::CollectCells(Coordinates center, double radius, size_t row_from, size_t row_to,
+            size_t col_from, size_t col_to, std::vector<Neighbour>& result) const {
+
+            std::vector<double> distances;
+            for (size_t row = row_from; row <= row_to; ++row) {
+                const uint32_t begin = cell_offsets_[row * columns_ + col_from];
+                const uint32_t end = cell_offsets_[row * columns_ + col_to + 1];
+
+                distances.resize(end - begin);
+                ComputeDistances(center, points_.View().Shifted(begin), end - begin, distances.data());
+
+                for (uint32_t i = begin; i < end; ++i) {
+                    if (distances[i - begin] <= radius) {
+                        result.push_back({ ids_[i], distances[i - begin] });
+                    }
+                }
+            }
+        }
+
+        // ---------- SegmentIndex ------------------
+
+        SegmentIndex::SegmentIndex(const allocator_type& alloc) :
+            cell_offsets_(alloc), entries_(alloc), wide_(alloc), owners_(alloc), bounds_(alloc) {}
+
+        void SegmentIndex::Build(std::span<const Segment> segments) {
+            cell_offsets_.clear();
+            entries_.clear();
+            wide_.clear();
+            owners_.clear();
+            bounds_.clear();
+            rows_ = columns_ = 0u;
+
+            if (segments.empty()) {
+                return;
+            }
+
+            area_ = BoundingBox::Empty();
+            owners_.reserve(segments.size());
+            bounds_.reserve(segments.size());
+            for (const Segment& segment : segments) {
+                BoundingBox bounds = BoundingBox::Empty();
+                bounds.Extend(segment.from);
+                bounds.Extend(segment.to);
+                area_.Extend(segment.from);
+                area_.Extend(segment.to);
+                owners_.push_back(segment.owner);
+                bounds_.push_back(bounds);
+            }
+
+            const size_t cells = std::max<size_t>(1u, segments.size() / 2);
+            const double height = area_.max_lat - area_.min_lat;
+            const double width = (area_.max_lng - area_.min_lng) * std::cos((area_.min_lat + area_.max_lat) / 2 * dr);
+            rows_ = ChooseRows(cells, height, width);
+            columns_ = std::max<size_t>(1u, cells / rows_);
+
+            cell_lat_ = height > 0. ? height / rows_ : 1.;
+            cell_lng_ = area_.max_lng > area_.min_lng ? (area_.max_lng - area_.min_lng) / columns_ : 1.;
+
+            // Два прохода, как и в GridIndex: подсчёт записей по ячейкам, затем раскладка номеров отрезков
+            cell_offsets_.assign(rows_ * columns_ + 1, 0u);
+            const auto for_each_cell = [this](const BoundingBox& bounds, auto&& action) {
+                const size_t col_from = GetColumn(bounds.min_lng);
+                const size_t col_to = GetColumn(bounds.max_lng);
+                for (size_t row = GetRow(bounds.min_lat); row <= GetRow(bounds.max_lat); ++row) {
+                    for (size_t column = col_from; column <= col_to; ++column) {
+                        action(row * columns_ + column);
+                    }
+                }
+            };
+            const auto is_wide = [this](const BoundingBox& bounds) {
+                return (GetRow(bounds.max_lat) - GetRow(bounds.min_lat) + 1)
+                    * (GetColumn(bounds.max_lng) - GetColumn(bounds.min_lng) + 1) > max_segment_cells;
+            };
+
+            for (size_t segment = 0; segment < bounds_.size(); ++segment) {
+                if (is_wide(bounds_[segment])) {
+                    wide_.push_back(static_cast<uint32_t>(segment));
+                    continue;
+                }
+                for_each_cell(bounds_[segment], [this](size_t cell) {
+                    ++cell_offsets_[cell + 1];
+                });
+            }
+            for (size_t i = 1; i < cell_offsets_.size(); ++i) {
+                cell_offsets_[i] += cell_offsets_[i - 1];
+            }
+
+            std::vector<uint32_t> cursor(cell_offsets_.begin(), cell_offsets_.end() - 1);
+            entries_.resize(cell_offsets_.back());
+            for (size_t segment = 0; segment < bounds_.size(); ++segment) {
+                if (is_wide(bounds_[segment])) {
+                    continue;
+                }
+                for_each_cell(bounds_[segment], [&](size_t cell) {
+                    entries_[cursor[cell]++] = static_cast<uint32_t>(segment);
+                });
+            }
+        }
+
+        std::vector<uint32_t> SegmentIndex::FindOwners(const BoundingBox& box) const {
+            std::vector<uint32_t> result;
+            if (bounds_.empty() || !box.IsValid() || !area_.Intersects(box)) {
+                return result;
+            }
+
+            for (const uint32_t segment : wide_) {
+                if (bounds_[segment].Intersects(box)) {
+                    result.push_back(owners_[segment]);
+                }
+            }
+
+            const size_t col_from = GetColumn(box.min_lng);
+            const size_t col_to = GetColumn(box.max_lng);
+            for (size_t row = GetRow(box.min_lat); row <= GetRow(box.max_lat); ++row) {
+                const uint32_t begin = cell_offsets_[row * columns_ + col_from];
+                const uint32_t end = cell_offsets_[row * columns_ + col_to + 1];
+                for (uint32_t i = begin; i < end; ++i) {
+                    if (bounds_[entries_[i]].Intersects(box)) {
+                        result.push_back(owners_[entries_[i]]);
+                    }
+                }
+            }
+
+            std::sort(result.begin(), result.end());
+            result.erase(std::unique(result.begin(), result.end()), result.end());
+            return result;
+        }
+
+        size_t SegmentIndex::GetRow(double lat) const {
+            if (!(lat > area_.min_lat)) {
+                return 0u;
+            }
+            return std::min(static_cast<size_t>((lat - area_.min_lat) / cell_lat_), rows_ - 1);
+        }
+
+        size_t SegmentIndex::GetColumn(double lng) const {
+            if (!(lng > area_.min_lng)) {
+                return 0u;
+            }
+            return std::min(static_cast<size_t>((lng - area_.min_lng) / cell_lng_), columns_ - 1);
+        }
+
+    }
+}
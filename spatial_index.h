@@ -0,0 +1,120 @@
+#pragma once
+
+#include "geo.h"
+
+#include <cstdint>
+#include <memory_resource>
+#include <span>
+#include <vector>
+
+namespace transport {
+    namespace geo {
+
+        struct Neighbour {
+            uint32_t id = 0u;
+            double distance = 0.;
+        };
+
+        // Равномерная сетка по широте и долготе, построенная один раз по неизменному набору точек.
+        // Точки лежат в таблице, упорядоченной по ячейкам, так что строка ячеек в диапазоне долгот
+        // образует непрерывный отрезок, расстояния до которого считаются одним пакетом.
+        // Эта таблица — единственная копия координат с тригонометрией: владелец индекса находит в ней точку по id
+        // через GetPosition, а не держит свою таблицу в порядке id.
+        // В среднем на ячейку приходится пара точек, поэтому запрос просматривает
+        // лишь ячейки, пересекающие охватывающий прямоугольник круга поиска
+        class GridIndex {
+        public:
+            using allocator_type = std::pmr::polymorphic_allocator<>;
+
+            GridIndex() = default;
+            explicit GridIndex(const allocator_type& alloc);
+
+            // id точки совпадает с её позицией в points
+            void Build(std::span<const Coordinates> points);
+
+            // Точки на расстоянии не больше radius метров от center, по возрастанию расстояния
+            std::vector<Neighbour> FindWithinRadius(Coordinates center, double radius) const;
+
+            // count ближайших к center точек, по возрастанию расстояния
+            std::vector<Neighbour> FindNearest(Coordinates center, size_t count) const;
+
+            // id точек внутри box по возрастанию
+            std::vector<uint32_t> FindInBox(const BoundingBox& box) const;
+
+            // Точки в порядке ячеек с заранее вычисленной тригонометрией
+            const CoordinatesTable& GetPoints() const;
+
+            // Позиция точки id в GetPoints()
+            uint32_t GetPosition(uint32_t id) const;
+
+        private:
+
+            size_t GetRow(double lat) const;
+            size_t GetColumn(double lng) const;
+
+            // Добавляет в result точки ячеек строк [row_from, row_to] и столбцов [col_from, col_to]
+            void CollectCells(Coordinates center, double radius, size_t row_from, size_t row_to,
+                size_t col_from, size_t col_to, std::vector<Neighbour>& result) const;
+
+            double min_lat_ = 0.;
+            double max_lat_ = 0.;
+            double min_lng_ = 0.;
+            double max_lng_ = 0.;
+            double cell_lat_ = 1.;
+            double cell_lng_ = 1.;
+            size_t rows_ = 0u;
+            size_t columns_ = 0u;
+
+            // Точки ячейки row * columns_ + column лежат на отрезке [cell_offsets_[cell], cell_offsets_[cell + 1])
+            // массивов ids_ и points_; positions_ — обратное к ids_ отображение id в позицию
+            std::pmr::vector<uint32_t> cell_offsets_;
+            std::pmr::vector<uint32_t> ids_;
+            std::pmr::vector<uint32_t> positions_;
+            CoordinatesTable points_;
+        };
+
+        // Равномерная сетка по отрезкам ломаных. Отрезок записывается во все ячейки, которые пересекает
+        // его охватывающий прямоугольник, так что запрос просматривает только ячейки области запроса.
+        // Отрезки, охватывающие слишком много ячеек, хранятся отдельным списком и проверяются каждым запросом,
+        // иначе несколько длинных отрезков раздули бы сетку до квадрата числа ячеек.
+        // Каждый отрезок принадлежит владельцу, например маршруту, и запрос возвращает владельцев
+        class SegmentIndex {
+        public:
+            using allocator_type = std::pmr::polymorphic_allocator<>;
+
+            struct Segment {
+                uint32_t owner = 0u;
+                Coordinates from;
+                Coordinates to;
+            };
+
+            SegmentIndex() = default;
+            explicit SegmentIndex(const allocator_type& alloc);
+
+            void Build(std::span<const Segment> segments);
+
+            // Владельцы отрезков, охватывающий прямоугольник которых пересекает box, по возрастанию без повторов
+            std::vector<uint32_t> FindOwners(const BoundingBox& box) const;
+
+        private:
+
+            size_t GetRow(double lat) const;
+            size_t GetColumn(double lng) const;
+
+            BoundingBox area_;
+            double cell_lat_ = 1.;
+            double cell_lng_ = 1.;
+            size_t rows_ = 0u;
+            size_t columns_ = 0u;
+
+            // Номера отрезков ячейки row * columns_ + column лежат на отрезке [cell_offsets_[cell], cell_offsets_[cell + 1])
+            std::pmr::vector<uint32_t> cell_offsets_;
+            std::pmr::vector<uint32_t> entries_;
+            // Номера отрезков, не записанных в сетку
+            std::pmr::vector<uint32_t> wide_;
+            std::pmr::vector<uint32_t> owners_;
+            std::pmr::vector<BoundingBox> bounds_;
+        };
+
+    }
+}
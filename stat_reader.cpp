@@ -1,22 +1,21 @@
 #include "stat_reader.h"
 
 #include <iostream>
-#include <set>
 
 namespace transport {
     namespace reader {
-        std::string BusesToString(const std::set<domain::Bus*, BusPtrHasher>& buses) {
+        std::string BusesToString(const CatalogueSnapshot& tansport_catalogue, std::span<const BusId> buses) {
             std::string result = "";
 
-            for (const domain::Bus* bus : buses) {
+            for (const BusId bus_id : buses) {
                 using namespace std;
-                result += bus->name_;
+                result += tansport_catalogue.GetBusById(bus_id).name_;
                 result += " "s;
             }
             return result;
         }
 
-        void ParseAndPrintBusStat(const TransportCatalogue& tansport_catalogue, std::string_view request,
+        void ParseAndPrintBusStat(const CatalogueSnapshot& tansport_catalogue, std::string_view request,
             std::ostream& output) {
             using namespace std;
 
@@ -36,7 +35,7 @@ namespace transport {
 
         }
 
-        void ParseAndPrintStopStat(const TransportCatalogue& tansport_catalogue, std::string_view request,
+        void ParseAndPrintStopStat(const CatalogueSnapshot& tansport_catalogue, std::string_view request,
             std::ostream& output) {
             using namespace std;
 
@@ -44,11 +43,11 @@ namespace transport {
             const domain::Stop* stop = tansport_catalogue.GetStop(stop_name);
 
             if (stop) {
-                if (tansport_catalogue.GetBusesByStop(stop_name).size() == 0) {
+                if (tansport_catalogue.GetBusesByStop(stop).size() == 0) {
                     output << "Stop "s << stop_name << ": no buses" << endl;
                 }
                 else {
-                    output << "Stop "s << stop_name << ": buses " << BusesToString(tansport_catalogue.GetBusesByStop(stop_name)) << endl;
+                    output << "Stop "s << stop_name << ": buses " << BusesToString(tansport_catalogue, tansport_catalogue.GetBusesByStop(stop)) << endl;
                 }
             }
             else {
@@ -57,7 +56,7 @@ namespace transport {
 
         }
 
-        void ParseAndPrintStat(const TransportCatalogue& tansport_catalogue, std::string_view request,
+        void ParseAndPrintStat(const CatalogueSnapshot& tansport_catalogue, std::string_view request,
             std::ostream& output) {
             using namespace std;
 
@@ -71,7 +70,7 @@ namespace transport {
             }
         }
 
-        void ShowCatalogue(std::istream& input, std::ostream& output, const TransportCatalogue& catalogue) {
+        void ShowCatalogue(std::istream& input, std::ostream& output, const CatalogueSnapshot& catalogue) {
             int stat_request_count;
             input >> stat_request_count >> std::ws;
             for (int i = 0; i < stat_request_count; ++i) {
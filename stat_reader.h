@@ -1,6 +1,7 @@
 #pragma once
 
 #include <iosfwd>
+#include <span>
 #include <string_view>
 
 #include "transport_catalogue.h"
@@ -8,18 +9,18 @@
 
 namespace transport {
     namespace reader {
-        std::string BusesToString(const std::set<domain::Bus*, BusPtrHasher>& buses);
+        std::string BusesToString(const CatalogueSnapshot& tansport_catalogue, std::span<const BusId> buses);
 
-        void ParseAndPrintBusStat(const TransportCatalogue& tansport_catalogue, std::string_view request,
+        void ParseAndPrintBusStat(const CatalogueSnapshot& tansport_catalogue, std::string_view request,
             std::ostream& output);
 
-        void ParseAndPrintStopStat(const TransportCatalogue& tansport_catalogue, std::string_view request,
+        void ParseAndPrintStopStat(const CatalogueSnapshot& tansport_catalogue, std::string_view request,
             std::ostream& output);
 
-        void ParseAndPrintStat(const TransportCatalogue& tansport_catalogue, std::string_view request,
+        void ParseAndPrintStat(const CatalogueSnapshot& tansport_catalogue, std::string_view request,
             std::ostream& output);
 
-        void ShowCatalogue(std::istream& input, std::ostream& output, const TransportCatalogue& catalogue);
+        void ShowCatalogue(std::istream& input, std::ostream& output, const CatalogueSnapshot& catalogue);
     }
 
 
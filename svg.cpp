@@ -6,10 +6,86 @@
 
 #include "svg.h"
 
+#include <charconv>
+#include <sstream>
+
 namespace svg {
 
     using namespace std::literals;
 
+    namespace {
+        // Наибольшая длина числа в формате %g с запасом
+        constexpr size_t max_number_length = 32;
+
+        // Порция, которой Document::Render передаёт текст в поток
+        constexpr size_t flush_threshold = 64 * 1024;
+
+        void AppendPoint(std::string& out, Point point) {
+            AppendNumber(out, point.x);
+            out.push_back(',');
+            AppendNumber(out, point.y);
+        }
+
+        void AppendPoints(std::string& out, const Point* points, size_t count) {
+            for (size_t i = 0; i < count; ++i) {
+                if (i != 0) {
+                    out.push_back(' ');
+                }
+                AppendPoint(out, points[i]);
+            }
+        }
+
+        struct BufferColorPrinter {
+            std::string& out;
+
+            void operator()(std::monostate) const {
+                out.append("none"sv);
+            }
+
+            void operator()(const std::string& color) const {
+                out.append(color);
+            }
+
+            void operator()(Rgb color) const {
+                out.append("rgb("sv);
+                AppendComponents(color);
+                out.push_back(')');
+            }
+
+            void operator()(Rgba color) const {
+                out.append("rgba("sv);
+                AppendComponents(color);
+                out.push_back(',');
+                AppendNumber(out, color.opacity);
+                out.push_back(')');
+            }
+
+            void AppendComponents(Rgb color) const {
+                AppendNumber(out, static_cast<uint32_t>(color.red));
+                out.push_back(',');
+                AppendNumber(out, static_cast<uint32_t>(color.green));
+                out.push_back(',');
+                AppendNumber(out, static_cast<uint32_t>(color.blue));
+            }
+        };
+    }
+
+    void AppendNumber(std::string& out, double value) {
+        char chars[max_number_length];
+        const auto result = std::to_chars(chars, chars + max_number_length, value, std::chars_format::general, 6);
+        out.append(chars, result.ptr);
+    }
+
+    void AppendNumber(std::string& out, uint32_t value) {
+        char chars[max_number_length];
+        const auto result = std::to_chars(chars, chars + max_number_length, value);
+        out.append(chars, result.ptr);
+    }
+
+    void AppendColor(std::string& out, const Color& color) {
+        std::visit(BufferColorPrinter{ out }, color);
+    }
+
     void Object::Render(const RenderContext& context) const {
         context.RenderIndent();
 
@@ -19,6 +95,18 @@ namespace svg {
         context.out << std::endl;
     }
 
+    void Object::Render(std::string& out, int indent) const {
+        out.append(indent, ' ');
+        RenderObject(out);
+        out.push_back('\n');
+    }
+
+    void Object::RenderObject(std::string& out) const {
+        std::ostringstream stream;
+        RenderObject(RenderContext(stream));
+        out.append(std::move(stream).str());
+    }
+
     // ---------- Circle ------------------
 
     Circle& Circle::SetCenter(Point center) {
@@ -39,6 +127,18 @@ namespace svg {
         out << "/>"sv;
     }
 
+    void Circle::RenderObject(std::string& out) const {
+        out.append("<circle cx=\""sv);
+        AppendNumber(out, center_.x);
+        out.append("\" cy=\""sv);
+        AppendNumber(out, center_.y);
+        out.append("\" r=\""sv);
+        AppendNumber(out, radius_);
+        out.push_back('"');
+        RenderAttrs(out);
+        out.append("/>"sv);
+    }
+
     // ---------- Polyline ------------------
 
     Polyline& Polyline::AddPoint(Point point) {
@@ -68,6 +168,25 @@ namespace svg {
 
     }
 
+    void Polyline::RenderObject(std::string& out) const {
+        out.append("<polyline points=\""sv);
+        AppendPoints(out, points_.data(), points_.size());
+        out.push_back('"');
+        RenderAttrs(out);
+        out.append("/>"sv);
+    }
+
+    // ---------- DocumentPolyline ------------------
+
+    void DocumentPolyline::Render(std::string& out, int indent, const Point* points) const {
+        out.append(indent, ' ');
+        out.append("<polyline points=\""sv);
+        AppendPoints(out, points + first_point_, point_count_);
+        out.push_back('"');
+        RenderAttrs(out);
+        out.append("/>\n"sv);
+    }
+
     // ---------- Text ------------------
     Text& Text::SetPosition(Point pos) {
         position_ = pos;
@@ -139,20 +258,165 @@ namespace svg {
         out << "</text>"sv;
     }
 
+    void Text::RenderObject(std::string& out) const {
+        out.append("<text"sv);
+        RenderAttrs(out);
+        out.append(" x=\""sv);
+        AppendNumber(out, position_.x);
+        out.append("\" y=\""sv);
+        AppendNumber(out, position_.y);
+        out.append("\" dx=\""sv);
+        AppendNumber(out, offset_.x);
+        out.append("\" dy=\""sv);
+        AppendNumber(out, offset_.y);
+        out.append("\" font-size=\""sv);
+        AppendNumber(out, font_size_);
+        out.push_back('"');
+
+        if (!font_family_.empty()) {
+            out.append(" font-family=\""sv).append(font_family_).push_back('"');
+        }
+        if (!font_weight_.empty()) {
+            out.append(" font-weight=\""sv).append(font_weight_).push_back('"');
+        }
+        out.push_back('>');
+
+        // Текст без спецсимволов копируется отрезками между ними
+        size_t start = 0;
+        for (size_t i = 0; i < data_.size(); ++i) {
+            std::string_view entity;
+            switch (data_[i]) {
+            case '"':
+                entity = "&quot;"sv;
+                break;
+            case '\'':
+                entity = "&apos;"sv;
+                break;
+            case '<':
+                entity = "&lt;"sv;
+                break;
+            case '>':
+                entity = "&gt;"sv;
+                break;
+            case '&':
+                entity = "&amp;"sv;
+                break;
+            default:
+                continue;
+            }
+            out.append(data_, start, i - start).append(entity);
+            start = i + 1;
+        }
+        out.append(data_, start).append("</text>"sv);
+    }
+
     // ---------- Document ------------------
 
+    void Document::Add(Circle circle) {
+        AddCircle() = std::move(circle);
+    }
+
+    void Document::Add(Text text) {
+        AddText() = std::move(text);
+    }
+
     void Document::AddPtr(std::unique_ptr<Object>&& obj) {
+        AddItem(Kind::OBJECT, objects_.size());
         objects_.emplace_back(move(obj));
     }
 
+    Circle& Document::AddCircle() {
+        AddItem(Kind::CIRCLE, circles_.size());
+        return circles_.emplace_back();
+    }
+
+    Text& Document::AddText() {
+        AddItem(Kind::TEXT, texts_.size());
+        return texts_.emplace_back();
+    }
+
+    DocumentPolyline& Document::AddPolyline() {
+        AddItem(Kind::POLYLINE, polylines_.size());
+        DocumentPolyline& polyline = polylines_.emplace_back();
+        polyline.first_point_ = points_.size();
+        return polyline;
+    }
+
+    Document& Document::AddPolylinePoint(Point point) {
+        points_.push_back(point);
+        ++polylines_.back().point_count_;
+        return *this;
+    }
+
+    void Document::Reserve(size_t circles, size_t texts, size_t polylines, size_t points) {
+        items_.reserve(items_.size() + circles + texts + polylines);
+        circles_.reserve(circles_.size() + circles);
+        texts_.reserve(texts_.size() + texts);
+        polylines_.reserve(polylines_.size() + polylines);
+        points_.reserve(points_.size() + points);
+    }
+
+    void Document::AddItem(Kind kind, size_t index) {
+        items_.push_back({ kind, static_cast<uint32_t>(index) });
+    }
+
+    void Document::RenderItem(std::string& out, const Item& item) const {
+        constexpr int indent = 2;
+
+        switch (item.kind) {
+        case Kind::CIRCLE:
+            circles_[item.index].Render(out, indent);
+            break;
+        case Kind::TEXT:
+            texts_[item.index].Render(out, indent);
+            break;
+        case Kind::POLYLINE:
+            polylines_[item.index].Render(out, indent, points_.data());
+            break;
+        case Kind::OBJECT:
+            objects_[item.index]->Render(out, indent);
+            break;
+        }
+    }
+
     void Document::Render(std::ostream& out) const {
-        out << "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>"sv << std::endl;
-        out << "<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\">"sv << std::endl;
-        RenderContext context(out, 2, 2);
-        for (const auto& obj : objects_) {
-            obj->Render(context);
+        std::string buffer;
+        buffer.reserve(2 * flush_threshold);
+        RenderBegin(buffer);
+        for (const Item& item : items_) {
+            RenderItem(buffer, item);
+            if (buffer.size() >= flush_threshold) {
+                out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+                buffer.clear();
+            }
+        }
+        RenderEnd(buffer);
+        out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    }
+
+    void Document::Render(std::string& out) const {
+        RenderBegin(out);
+        RenderItems(out, 0, items_.size());
+        RenderEnd(out);
+    }
+
+    size_t Document::GetSize() const {
+        return items_.size();
+    }
+
+    void Document::RenderBegin(std::string& out) {
+        out.append("<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n"sv);
+        out.append("<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\">\n"sv);
+    }
+
+    void Document::RenderItems(std::string& out, size_t first, size_t last) const {
+        for (size_t i = first; i < last; ++i) {
+            RenderItem(out, items_[i]);
         }
-        out << "</svg>"sv;
+    }
+
+    void Document::RenderEnd(std::string& out) {
+        out.append("</svg>"sv);
     }
 
 }  // namespace svg
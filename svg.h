@@ -8,6 +8,7 @@
 #include <memory>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <variant>
 #include <vector>
 
@@ -20,6 +21,8 @@ namespace svg {
             , y(y) {
         }
 
+        bool operator==(const Point& other) const = default;
+
         double x = 0;
         double y = 0;
     };
@@ -63,10 +66,17 @@ namespace svg {
     public:
         void Render(const RenderContext& context) const;
 
+        // Дописывает тег в буфер с отступом indent пробелов; текст совпадает с выводом в поток
+        void Render(std::string& out, int indent) const;
+
         virtual ~Object() = default;
 
     private:
         virtual void RenderObject(const RenderContext& context) const = 0;
+
+        // По умолчанию тег выводится в поток, а затем копируется в буфер.
+        // Фигуры библиотеки пишут в буфер напрямую
+        virtual void RenderObject(std::string& out) const;
     };
 
     class ObjectContainer {
@@ -123,7 +133,7 @@ namespace svg {
             os << "none"sv;
         }
 
-        void operator()(std::string color) const {
+        void operator()(const std::string& color) const {
             using namespace std::literals;
             os << color;
         }
@@ -139,7 +149,7 @@ namespace svg {
         }
     };
 
-    inline std::ostream& operator<< (std::ostream& os, Color color) {
+    inline std::ostream& operator<< (std::ostream& os, const Color& color) {
         std::visit(OstreamColorPrinter{ os }, color);
         return os;
     }
@@ -150,22 +160,23 @@ namespace svg {
         SQUARE,
     };
 
-    inline std::ostream& operator<<(std::ostream& os, StrokeLineCap cap) {
+    inline std::string_view ToString(StrokeLineCap cap) {
 
         using namespace std::literals;
 
         switch (cap) {
         case StrokeLineCap::BUTT:
-            os << "butt"sv;
-            break;
+            return "butt"sv;
         case StrokeLineCap::ROUND:
-            os << "round"sv;
-            break;
+            return "round"sv;
         case StrokeLineCap::SQUARE:
-            os << "square"sv;
-            break;
+            return "square"sv;
         }
-        return os;
+        return {};
+    }
+
+    inline std::ostream& operator<<(std::ostream& os, StrokeLineCap cap) {
+        return os << ToString(cap);
     }
 
     enum class StrokeLineJoin {
@@ -176,30 +187,35 @@ namespace svg {
         ROUND,
     };
 
-    inline std::ostream& operator<<(std::ostream& os, StrokeLineJoin join) {
+    inline std::string_view ToString(StrokeLineJoin join) {
 
         using namespace std::literals;
 
         switch (join) {
         case StrokeLineJoin::ARCS:
-            os << "arcs"sv;
-            break;
+            return "arcs"sv;
         case StrokeLineJoin::BEVEL:
-            os << "bevel"sv;
-            break;
+            return "bevel"sv;
         case StrokeLineJoin::MITER:
-            os << "miter"sv;
-            break;
+            return "miter"sv;
         case StrokeLineJoin::MITER_CLIP:
-            os << "miter-clip"sv;
-            break;
+            return "miter-clip"sv;
         case StrokeLineJoin::ROUND:
-            os << "round"sv;
-            break;
+            return "round"sv;
         }
-        return os;
+        return {};
+    }
+
+    inline std::ostream& operator<<(std::ostream& os, StrokeLineJoin join) {
+        return os << ToString(join);
     }
 
+    // Дописывают значение в буфер в том же виде, что и оператор << потока с настройками по умолчанию:
+    // double выводится с шестью значащими цифрами, но через std::to_chars, без обращения к локали
+    void AppendNumber(std::string& out, double value);
+    void AppendNumber(std::string& out, uint32_t value);
+    void AppendColor(std::string& out, const Color& color);
+
     template <typename Owner>
     class PathProps {
     public:
@@ -253,6 +269,32 @@ namespace svg {
             }
         }
 
+        void RenderAttrs(std::string& out) const {
+            using namespace std::literals;
+
+            if (fill_color_) {
+                out.append(" fill=\""sv);
+                AppendColor(out, *fill_color_);
+                out.push_back('"');
+            }
+            if (stroke_color_) {
+                out.append(" stroke=\""sv);
+                AppendColor(out, *stroke_color_);
+                out.push_back('"');
+            }
+            if (stroke_width_) {
+                out.append(" stroke-width=\""sv);
+                AppendNumber(out, *stroke_width_);
+                out.push_back('"');
+            }
+            if (stroke_line_cap_) {
+                out.append(" stroke-linecap=\""sv).append(ToString(*stroke_line_cap_)).push_back('"');
+            }
+            if (stroke_line_join_) {
+                out.append(" stroke-linejoin=\""sv).append(ToString(*stroke_line_join_)).push_back('"');
+            }
+        }
+
     private:
         Owner& AsOwner() {
             // static_cast безопасно преобразует *this к Owner&,
@@ -278,6 +320,7 @@ namespace svg {
 
     private:
         void RenderObject(const RenderContext& context) const override;
+        void RenderObject(std::string& out) const override;
 
         Point center_;
         double radius_ = 1.0;
@@ -297,6 +340,7 @@ namespace svg {
          */
     private:
         void RenderObject(const RenderContext& context) const override;
+        void RenderObject(std::string& out) const override;
 
         std::vector<Point> points_;
     };
@@ -329,6 +373,7 @@ namespace svg {
     private:
 
         void RenderObject(const RenderContext& context) const override;
+        void RenderObject(std::string& out) const override;
 
         Point position_;
         Point offset_;
@@ -338,6 +383,20 @@ namespace svg {
         std::string data_;
     };
 
+    /*
+     * Ломаная, принадлежащая документу: её вершины лежат подряд в общем буфере точек документа.
+     * Создаётся методом Document::AddPolyline, вершины добавляются методом Document::AddPolylinePoint
+     */
+    class DocumentPolyline final : public PathProps<DocumentPolyline> {
+    private:
+        friend class Document;
+
+        void Render(std::string& out, int indent, const Point* points) const;
+
+        size_t first_point_ = 0;
+        size_t point_count_ = 0;
+    };
+
     class Document : public ObjectContainer {
     public:
         /*
@@ -347,13 +406,65 @@ namespace svg {
          doc.Add(Circle().SetCenter({20, 30}).SetRadius(15));
         */
 
+        // Круги, тексты и ломаные хранятся по значению в массивах своего типа, а порядок вывода
+        // задаёт общий список элементов. Прочие объекты хранятся по указателю
+        using ObjectContainer::Add;
+        void Add(Circle circle);
+        void Add(Text text);
+
         // Добавляет в svg-документ объект-наследник svg::Object
         void AddPtr(std::unique_ptr<Object>&& obj) override;
 
-        // Выводит в ostream svg-представление документа
+        // Создают фигуру прямо в документе. Ссылка действительна до следующего добавления фигуры того же типа
+        Circle& AddCircle();
+        Text& AddText();
+        DocumentPolyline& AddPolyline();
+
+        // Добавляет вершину к последней созданной ломаной
+        Document& AddPolylinePoint(Point point);
+
+        // Заранее выделяет место под фигуры, чтобы документ известного размера собирался без перевыделений
+        void Reserve(size_t circles, size_t texts, size_t polylines, size_t points);
+
+        // Выводит в ostream svg-представление документа.
+        // Текст собирается в буфере и передаётся в поток порциями
         void Render(std::ostream& out) const;
 
+        // Дописывает svg-представление документа в буфер
+        void Render(std::string& out) const;
+
+        // Число элементов документа
+        size_t GetSize() const;
+
+        // Части вывода Render(std::string&): начало документа, элементы [first, last) и окончание.
+        // Элементы разных документов и разных отрезков можно выводить параллельно в отдельные буферы,
+        // а затем склеить по порядку
+        static void RenderBegin(std::string& out);
+        void RenderItems(std::string& out, size_t first, size_t last) const;
+        static void RenderEnd(std::string& out);
+
     private:
+        enum class Kind : uint8_t {
+            CIRCLE,
+            TEXT,
+            POLYLINE,
+            OBJECT,
+        };
+
+        // Элемент документа: тип фигуры и её позиция в массиве этого типа
+        struct Item {
+            Kind kind;
+            uint32_t index;
+        };
+
+        void AddItem(Kind kind, size_t index);
+        void RenderItem(std::string& out, const Item& item) const;
+
+        std::vector<Item> items_;
+        std::vector<Circle> circles_;
+        std::vector<Text> texts_;
+        std::vector<DocumentPolyline> polylines_;
+        std::vector<Point> points_;
         std::vector<std::unique_ptr<Object>> objects_;
     };
 
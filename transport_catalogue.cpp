@@ -1,119 +1,302 @@
 #include "transport_catalogue.h"
 
 #include <algorithm>
-#include <memory>
-#include <set>
+#include <atomic>
 #include <stdexcept>
 
 
 namespace transport {
 
-	void TransportCatalogue::AddStop(domain::Stop&& stop) {
+	//------------------------ CatalogueBuilder -------------------------
+
+	void CatalogueBuilder::AddStop(domain::Stop&& stop) {
+		if (auto iterator = stopname_to_stop_.find(stop.name_); iterator != stopname_to_stop_.end()) {
+			iterator->second->coordinate_ = stop.coordinate_;
+			return;
+		}
+
 		stops_.push_back(std::move(stop));
 		stopname_to_stop_[stops_.back().name_] = &stops_.back();
+	}
+
+	void CatalogueBuilder::AddBus(domain::Bus&& bus) {
 
-		stop_to_buses_[stops_.back().name_] = std::set<domain::Bus*, BusPtrHasher>();
+		domain::Bus* bus_ptr = nullptr;
 
+		// Ключ индекса ссылается на строку с именем, поэтому при замене маршрута он пересоздаётся
+		if (auto iterator = busname_to_bus_.find(bus.name_); iterator != busname_to_bus_.end()) {
+			bus_ptr = iterator->second;
+			busname_to_bus_.erase(iterator);
+			*bus_ptr = std::move(bus);
+		}
+		else {
+			bus_ptr = &buses_.emplace_back(std::move(bus));
+		}
+		busname_to_bus_[bus_ptr->name_] = bus_ptr;
+	}
+
+	void CatalogueBuilder::SetDistance(const domain::Stop* from, const domain::Stop* to, size_t distance) {
+		distances_[std::make_pair(from, to)] = distance;
 	}
 
-	void TransportCatalogue::AddBus(domain::Bus&& bus) {
+	const domain::Stop* CatalogueBuilder::GetStop(std::string_view name) const {
+		auto pair = stopname_to_stop_.find(name);
+		return pair != stopname_to_stop_.end() ? pair->second : nullptr;
+	}
+
+	size_t CatalogueBuilder::GetDistanceDirectly(const domain::Stop* from, const domain::Stop* to) const {
+		auto iterator = distances_.find(std::make_pair(from, to));
+		return iterator != distances_.end() ? iterator->second : 0u;
+	}
+
+	CatalogueSnapshot CatalogueBuilder::Freeze() const {
+		static std::atomic<uint64_t> last_version = 0u;
+
+		CatalogueSnapshot snapshot;
+		snapshot.version_ = ++last_version;
+
+		// Временные индексы нужны только на время заморозки
+		std::pmr::monotonic_buffer_resource scratch;
+
+		auto by_name = [](const auto* lhs, const auto* rhs) {
+			return lhs->name_ < rhs->name_;
+		};
+
+		std::pmr::vector<const domain::Stop*> sorted_stops(&scratch);
+		sorted_stops.reserve(stops_.size());
+		for (const auto& stop : stops_) {
+			sorted_stops.push_back(&stop);
+		}
+		std::sort(sorted_stops.begin(), sorted_stops.end(), by_name);
+
+		std::pmr::vector<const domain::Bus*> sorted_buses(&scratch);
+		sorted_buses.reserve(buses_.size());
+		for (const auto& bus : buses_) {
+			sorted_buses.push_back(&bus);
+		}
+		std::stable_sort(sorted_buses.begin(), sorted_buses.end(), by_name);
 
-		auto& bus_ref = buses_.emplace_back(std::move(bus));
-		busname_to_bus_[buses_.back().name_] = &buses_.back();
+		// Остановки копируются в плоский массив, указатели сборщика переводятся в указатели снимка
+		std::pmr::unordered_map<const domain::Stop*, const domain::Stop*> frozen_stop(&scratch);
+		frozen_stop.reserve(sorted_stops.size());
 
-		for (const domain::Stop* stop : buses_.back().stops_) {
-			stop_to_buses_[stop->name_].insert(&buses_.back());
+		snapshot.stops_.reserve(sorted_stops.size());
+		for (const domain::Stop* stop : sorted_stops) {
+			domain::Stop& frozen = snapshot.stops_.emplace_back(*stop);
+			frozen.id_ = snapshot.stops_.size() - 1;
+			frozen_stop[stop] = &frozen;
 		}
 
-		if (!bus_ref.is_circular_)
-		{
-			for (int i = bus_ref.stops_.size() - 2; i >= 0; --i)
-			{
-				bus_ref.stops_.push_back(bus_ref.stops_[i]);
+		std::pmr::vector<geo::Coordinates> stops_coordinates(&scratch);
+		stops_coordinates.reserve(snapshot.stops_.size());
+		for (const auto& stop : snapshot.stops_) {
+			stops_coordinates.push_back(stop.coordinate_);
+		}
+		snapshot.stops_index_.Build(stops_coordinates);
+
+		snapshot.buses_.reserve(sorted_buses.size());
+		for (const domain::Bus* bus : sorted_buses) {
+			domain::Bus& frozen = snapshot.buses_.emplace_back(*bus);
+			frozen.id_ = snapshot.buses_.size() - 1;
+			for (const domain::Stop*& stop : frozen.stops_) {
+				stop = frozen_stop.at(stop);
 			}
 		}
 
+		snapshot.stopname_to_stop_.reserve(snapshot.stops_.size());
+		for (const auto& stop : snapshot.stops_) {
+			snapshot.stopname_to_stop_[stop.name_] = &stop;
+		}
+
+		snapshot.busname_to_bus_.reserve(snapshot.buses_.size());
+		for (const auto& bus : snapshot.buses_) {
+			snapshot.busname_to_bus_[bus.name_] = &bus;
+		}
+
+		// Обратный ход некольцевого маршрута проходит по тем же отрезкам, поэтому в индекс попадает только прямой.
+		// Маршрут из одной остановки представлен вырожденным отрезком
+		std::pmr::vector<geo::SegmentIndex::Segment> route_segments(&scratch);
+		for (const auto& bus : snapshot.buses_) {
+			const BusId id = static_cast<BusId>(bus.id_);
+			if (bus.stops_.size() == 1) {
+				route_segments.push_back({ id, bus.stops_[0]->coordinate_, bus.stops_[0]->coordinate_ });
+			}
+			for (size_t i = 1; i < bus.stops_.size(); ++i) {
+				route_segments.push_back({ id, bus.stops_[i - 1]->coordinate_, bus.stops_[i]->coordinate_ });
+			}
+		}
+		snapshot.routes_index_.Build(route_segments);
+
+		// Маршруты остановки упорядочены посимвольным сравнением имён как знаковых char, а не побайтовым,
+		// как у std::string: для имён не из ASCII эти порядки расходятся
+		std::pmr::vector<const domain::Bus*> stop_bus_order(&scratch);
+		stop_bus_order.reserve(snapshot.buses_.size());
+		for (const auto& bus : snapshot.buses_) {
+			stop_bus_order.push_back(&bus);
+		}
+		std::stable_sort(stop_bus_order.begin(), stop_bus_order.end(), [](const domain::Bus* lhs, const domain::Bus* rhs) {
+			return std::lexicographical_compare(lhs->name_.begin(), lhs->name_.end(), rhs->name_.begin(), rhs->name_.end());
+		});
+
+		// Маршруты обходятся в этом порядке, поэтому отрезки индекса получаются уже отсортированными.
+		// Первый проход считает маршруты каждой остановки, второй раскладывает id по отрезкам
+		const BusId no_bus = static_cast<BusId>(-1);
+		std::pmr::vector<BusId> last_bus(snapshot.stops_.size(), no_bus, &scratch);
+
+		snapshot.stop_bus_offsets_.assign(snapshot.stops_.size() + 1, 0u);
+		for (const domain::Bus* bus : stop_bus_order) {
+			for (const domain::Stop* stop : bus->stops_) {
+				if (last_bus[stop->id_] != bus->id_) {
+					last_bus[stop->id_] = static_cast<BusId>(bus->id_);
+					++snapshot.stop_bus_offsets_[stop->id_ + 1];
+				}
+			}
+		}
+		for (size_t i = 1; i < snapshot.stop_bus_offsets_.size(); ++i) {
+			snapshot.stop_bus_offsets_[i] += snapshot.stop_bus_offsets_[i - 1];
+		}
+
+		std::pmr::vector<uint32_t> cursor(snapshot.stop_bus_offsets_.begin(), snapshot.stop_bus_offsets_.end() - 1, &scratch);
+		std::fill(last_bus.begin(), last_bus.end(), no_bus);
+
+		snapshot.stop_bus_ids_.resize(snapshot.stop_bus_offsets_.back());
+		for (const domain::Bus* bus : stop_bus_order) {
+			for (const domain::Stop* stop : bus->stops_) {
+				if (last_bus[stop->id_] != bus->id_) {
+					last_bus[stop->id_] = static_cast<BusId>(bus->id_);
+					snapshot.stop_bus_ids_[cursor[stop->id_]++] = static_cast<BusId>(bus->id_);
+				}
+			}
+		}
+
+		// Если расстояние задано только в одну сторону, оно же используется и для обратного направления
+		snapshot.distances_.reserve(distances_.size() * 2);
+		for (const auto& [stops, distance] : distances_) {
+			const auto [from, to] = stops;
+			if (!from || !to) {
+				continue;
+			}
+			const size_t inverse = GetDistanceDirectly(to, from);
+
+			snapshot.distances_[{ frozen_stop.at(from), frozen_stop.at(to) }] = distance > 0 ? distance : inverse;
+			if (distances_.count({ to, from }) == 0) {
+				snapshot.distances_[{ frozen_stop.at(to), frozen_stop.at(from) }] = distance;
+			}
+		}
+
+		snapshot.bus_infos_.reserve(snapshot.buses_.size());
+		for (const auto& bus : snapshot.buses_) {
+			snapshot.bus_infos_.push_back(snapshot.ComputeBusInfo(bus));
+		}
+
+		return snapshot;
 	}
 
-	void TransportCatalogue::SetDistance(domain::Stop* from, domain::Stop* to, size_t distance) {
-		distances_[std::make_pair(from, to)] = distance;
+	//------------------------ CatalogueSnapshot -------------------------
+
+	CatalogueSnapshot::CatalogueSnapshot() :
+		arena_(std::make_unique<std::pmr::monotonic_buffer_resource>()),
+		stops_(arena_.get()), buses_(arena_.get()), stops_index_(arena_.get()), routes_index_(arena_.get()),
+		stopname_to_stop_(arena_.get()), busname_to_bus_(arena_.get()),
+		stop_bus_offsets_(arena_.get()), stop_bus_ids_(arena_.get()),
+		distances_(arena_.get()), bus_infos_(arena_.get()) {
+	}
+
+	uint64_t CatalogueSnapshot::GetVersion() const {
+		return version_;
 	}
 
-	const domain::Stop* TransportCatalogue::GetStop(std::string_view name) const {
+	const domain::Stop* CatalogueSnapshot::GetStop(std::string_view name) const {
 		auto pair = stopname_to_stop_.find(name);
 		return pair != stopname_to_stop_.end() ? pair->second : nullptr;
 	}
 
-	const domain::Bus* TransportCatalogue::GetBus(std::string_view name) const {
+	const domain::Bus* CatalogueSnapshot::GetBus(std::string_view name) const {
 		auto pair = busname_to_bus_.find(name);
 		return pair != busname_to_bus_.end() ? pair->second : nullptr;
 	}
 
-	const std::set<domain::Bus*, BusPtrHasher>& TransportCatalogue::GetBusesByStop(std::string_view name) const {
-		auto iterator = stop_to_buses_.find(name);
-		if (iterator != stop_to_buses_.end()) {
-			return iterator->second;
-		}
-		else {
-			static const std::set<domain::Bus*, BusPtrHasher> empty_set;
-			return empty_set;
-		}
+	const domain::Bus& CatalogueSnapshot::GetBusById(BusId id) const {
+		return buses_.at(id);
 	}
 
-	size_t TransportCatalogue::GetDistanceDirectly(domain::Stop* from, domain::Stop* to) const{
-		if (distances_.count(std::make_pair(from, to)) > 0) {
-			return distances_.at(std::make_pair(from, to));
-		}
-		else {
-			return 0U;
-		}
+	const domain::Stop& CatalogueSnapshot::GetStopById(size_t id) const {
+		return stops_.at(id);
 	}
 
-	size_t TransportCatalogue::GetDistance(domain::Stop* from, domain::Stop* to) const {
-		size_t result = GetDistanceDirectly(from, to);
-		return (result > 0 ? result : GetDistanceDirectly(to, from));
+	std::span<const BusId> CatalogueSnapshot::GetBusesByStop(const domain::Stop* stop) const {
+		const uint32_t begin = stop_bus_offsets_.at(stop->id_);
+		const uint32_t end = stop_bus_offsets_.at(stop->id_ + 1);
+		return std::span<const BusId>(stop_bus_ids_).subspan(begin, end - begin);
 	}
 
-	domain::BusInfo TransportCatalogue::GetBusInfo(const domain::Bus* bus) const {
+	size_t CatalogueSnapshot::GetDistance(const domain::Stop* from, const domain::Stop* to) const {
+		auto iterator = distances_.find(std::make_pair(from, to));
+		return iterator != distances_.end() ? iterator->second : 0u;
+	}
 
-		domain::BusInfo bus_info;
+	const domain::BusInfo& CatalogueSnapshot::GetBusInfo(const domain::Bus* bus) const {
+		return bus_infos_.at(bus->id_);
+	}
 
-		bus_info.stops_count_ = bus->stops_.size();
+	std::span<const domain::Bus> CatalogueSnapshot::GetAllBuses() const {
+		return buses_;
+	}
 
-		std::set<const domain::Stop*> uniq_stops(bus->stops_.begin(), bus->stops_.end());
-		bus_info.unique_stops_count_ = uniq_stops.size();
+	std::span<const domain::Stop> CatalogueSnapshot::GetAllStops() const {
+		return stops_;
+	}
 
-		for (size_t i = 1; i < bus->stops_.size(); ++i) {
-			domain::Stop* prev_stop = const_cast<domain::Stop*>(bus->stops_[i - 1]);
-			domain::Stop* curr_stop = const_cast<domain::Stop*>(bus->stops_[i]);
+	const geo::GridIndex& CatalogueSnapshot::GetStopsIndex() const {
+		return stops_index_;
+	}
 
-			bus_info.route_length_ += GetDistance(prev_stop, curr_stop);
-			bus_info.geo_route_length_ += transport::geo::ComputeDistance(prev_stop->coordinate_, curr_stop->coordinate_);
-		}
+	const geo::SegmentIndex& CatalogueSnapshot::GetRoutesIndex() const {
+		return routes_index_;
+	}
 
-		bus_info.curvature_ = bus_info.route_length_ / bus_info.geo_route_length_;
+	domain::BusInfo CatalogueSnapshot::ComputeBusInfo(const domain::Bus& bus) const {
 
-		return bus_info;
-	}
+		domain::BusInfo bus_info;
 
-	const std::map<std::string_view, domain::Bus*> TransportCatalogue::GetAllBuses() const {
-		std::map<std::string_view, domain::Bus*> result;
+		bus_info.stops_count_ = bus.GetRouteSize();
 
-		for (const auto& bus : busname_to_bus_) {
-			result.emplace(bus);
+		std::vector<size_t> uniq_stops;
+		uniq_stops.reserve(bus.stops_.size());
+		for (const domain::Stop* stop : bus.stops_) {
+			uniq_stops.push_back(stop->id_);
 		}
+		std::sort(uniq_stops.begin(), uniq_stops.end());
+		bus_info.unique_stops_count_ = std::unique(uniq_stops.begin(), uniq_stops.end()) - uniq_stops.begin();
 
-		return result;
-	}
+		// Географические длины перегонов прямого хода считаются одним пакетом по координатам остановок
+		// из таблицы их индекса, где тригонометрия уже вычислена. Обратный ход некольцевого маршрута проходит те же перегоны,
+		// поэтому их длины переиспользуются, а дорожное расстояние берётся в обратном направлении
+		geo::CoordinatesTable route_geo;
+		route_geo.Reserve(bus.stops_.size());
+		for (const domain::Stop* stop : bus.stops_) {
+			route_geo.AddFrom(stops_index_.GetPoints(), stops_index_.GetPosition(static_cast<uint32_t>(stop->id_)));
+		}
 
-	const std::map<std::string_view, domain::Stop*> TransportCatalogue::GetAllStops() const {
-		std::map<std::string_view, domain::Stop*> result;
+		const size_t hops_count = bus.stops_.empty() ? 0u : bus.stops_.size() - 1;
+		std::vector<double> hops_geo_length(hops_count);
+		geo::ComputeDistances(route_geo.View(), route_geo.View().Shifted(1), hops_count, hops_geo_length.data());
+
+		for (size_t i = 1; i < bus.stops_.size(); ++i) {
+			bus_info.route_length_ += GetDistance(bus.stops_[i - 1], bus.stops_[i]);
+			bus_info.geo_route_length_ += hops_geo_length[i - 1];
+		}
 
-		for (const auto& stop : stopname_to_stop_) {
-			result.emplace(stop);
+		if (!bus.is_circular_ && !bus.stops_.empty()) {
+			for (size_t i = bus.stops_.size() - 1; i > 0; --i) {
+				bus_info.route_length_ += GetDistance(bus.stops_[i], bus.stops_[i - 1]);
+				bus_info.geo_route_length_ += hops_geo_length[i - 1];
+			}
 		}
-		
-		return result;
+
+		bus_info.curvature_ = bus_info.route_length_ / bus_info.geo_route_length_;
+
+		return bus_info;
 	}
 
 }
@@ -2,63 +2,134 @@
 
 #include "domain.h"
 #include "geo.h"
+#include "spatial_index.h"
 
 
+#include <cstdint>
 #include <deque>
-#include <optional>
+#include <memory>
+#include <memory_resource>
+#include <span>
 #include <string>
 #include <string_view>
 #include <unordered_map>
-#include <unordered_set>
 #include <vector>
-#include <map>
 
 namespace transport{
 
-	struct BusPtrHasher {
-
-		bool operator()(domain::Bus* lhs, domain::Bus* rhs) const {
-			return *lhs < *rhs;
-		};
-	};
-
 	struct PairHasher {
-		std::size_t operator()(const std::pair<domain::Stop*, domain::Stop*>& pair) const {
+		std::size_t operator()(const std::pair<const domain::Stop*, const domain::Stop*>& pair) const {
 			return std::hash<const void*>{}(static_cast<const void*>(pair.first)) * 17
 				+ std::hash<const void*>{}(static_cast<const void*>(pair.second));
 		}
 	};
 
-	class TransportCatalogue {
+	// Идентификатор маршрута совпадает с его рангом по имени, поэтому сравнение id равносильно сравнению имён
+	using BusId = uint32_t;
+
+	using DistanceMap = std::pmr::unordered_map<std::pair<const domain::Stop*, const domain::Stop*>, size_t, PairHasher>;
+
+	class CatalogueSnapshot;
+
+	// Заполняется на этапе загрузки базы, после чего замораживается в CatalogueSnapshot.
+	// Повторное добавление остановки или маршрута с тем же именем обновляет существующую запись.
+	// Все данные загрузки размещаются в пуле сборщика и освобождаются вместе с ним. Пул, в отличие
+	// от монотонной арены, переиспользует память заменённых записей, так что долгоживущий сборщик
+	// при обновлениях справочника не растёт без предела
+	class CatalogueBuilder {
 	public:
 
+		CatalogueBuilder() = default;
+
+		CatalogueBuilder(const CatalogueBuilder&) = delete;
+		CatalogueBuilder& operator=(const CatalogueBuilder&) = delete;
+
 		void AddStop(domain::Stop&& stop);
 		void AddBus(domain::Bus&& bus);
-		void SetDistance(domain::Stop* from, domain::Stop* to, size_t distance);
+		void SetDistance(const domain::Stop* from, const domain::Stop* to, size_t distance);
+
+		const domain::Stop* GetStop(std::string_view name) const;
+
+		CatalogueSnapshot Freeze() const;
+
+	private:
+
+		size_t GetDistanceDirectly(const domain::Stop* from, const domain::Stop* to) const;
+
+		std::pmr::unsynchronized_pool_resource pool_;
+
+		std::pmr::deque<domain::Stop> stops_{ &pool_ };
+		std::pmr::deque<domain::Bus> buses_{ &pool_ };
+
+		std::pmr::unordered_map<std::string_view, domain::Stop*> stopname_to_stop_{ &pool_ };
+		std::pmr::unordered_map<std::string_view, domain::Bus*> busname_to_bus_{ &pool_ };
+		DistanceMap distances_{ &pool_ };
+
+	};
+
+	// Неизменяемый справочник, оптимизированный под чтение.
+	// Остановки и маршруты хранятся в плоских массивах, отсортированных по имени,
+	// так что id объекта совпадает с его позицией в массиве.
+	// Данные снимка живут в собственной арене, которая освобождается целиком вместе со снимком.
+	class CatalogueSnapshot {
+	public:
+
+		CatalogueSnapshot(CatalogueSnapshot&&) = default;
+		CatalogueSnapshot& operator=(CatalogueSnapshot&&) = delete;
+
+		CatalogueSnapshot(const CatalogueSnapshot&) = delete;
+		CatalogueSnapshot& operator=(const CatalogueSnapshot&) = delete;
+
+		// Уникальный номер снимка: каждый вызов Freeze выдаёт новое значение
+		uint64_t GetVersion() const;
 
 		const domain::Stop* GetStop(std::string_view name) const;
 		const domain::Bus* GetBus(std::string_view name) const;
+		const domain::Bus& GetBusById(BusId id) const;
+		const domain::Stop& GetStopById(size_t id) const;
+
+		// Идентификаторы маршрутов, проходящих через остановку, упорядочены по имени
+		std::span<const BusId> GetBusesByStop(const domain::Stop* stop) const;
 
-		const std::set<domain::Bus*, BusPtrHasher>& GetBusesByStop(std::string_view name) const;
+		size_t GetDistance(const domain::Stop* from, const domain::Stop* to) const;
 
-		size_t GetDistanceDirectly(domain::Stop* from, domain::Stop* to) const;
-		size_t GetDistance(domain::Stop* from, domain::Stop* to) const;
+		const domain::BusInfo& GetBusInfo(const domain::Bus* bus) const;
 
-		domain::BusInfo GetBusInfo(const domain::Bus* bus) const;
+		std::span<const domain::Bus> GetAllBuses() const;
+		std::span<const domain::Stop> GetAllStops() const;
 
-		const std::map<std::string_view, domain::Bus*> GetAllBuses() const;
-		const std::map<std::string_view, domain::Stop*> GetAllStops() const;
+		// Пространственный индекс остановок: id найденных точек совпадают с id остановок
+		const geo::GridIndex& GetStopsIndex() const;
+
+		// Пространственный индекс отрезков маршрутов: владелец отрезка — id маршрута
+		const geo::SegmentIndex& GetRoutesIndex() const;
 
 	private:
+		friend class CatalogueBuilder;
+
+		CatalogueSnapshot();
+
+		domain::BusInfo ComputeBusInfo(const domain::Bus& bus) const;
+
+		// Арена держится по указателю, чтобы перемещение снимка не меняло адрес ресурса памяти
+		std::unique_ptr<std::pmr::monotonic_buffer_resource> arena_;
+
+		uint64_t version_ = 0u;
 
-		std::deque<domain::Stop> stops_;
-		std::deque<domain::Bus> buses_;
+		std::pmr::vector<domain::Stop> stops_;
+		std::pmr::vector<domain::Bus> buses_;
+		geo::GridIndex stops_index_;
+		geo::SegmentIndex routes_index_;
 
-		std::unordered_map<std::string_view, domain::Stop* > stopname_to_stop_;
-		std::unordered_map<std::string_view, domain::Bus*> busname_to_bus_;
+		std::pmr::unordered_map<std::string_view, const domain::Stop*> stopname_to_stop_;
+		std::pmr::unordered_map<std::string_view, const domain::Bus*> busname_to_bus_;
 
-		std::unordered_map<std::string_view, std::set<domain::Bus*, BusPtrHasher> > stop_to_buses_;
-		std::unordered_map<std::pair<domain::Stop*, domain::Stop*>, size_t, PairHasher> distances_;
+		// Индекс остановка -> маршруты: id маршрутов остановки stop лежат в stop_bus_ids_
+		// на отрезке [stop_bus_offsets_[stop], stop_bus_offsets_[stop + 1])
+		std::pmr::vector<uint32_t> stop_bus_offsets_;
+		std::pmr::vector<BusId> stop_bus_ids_;
+		DistanceMap distances_;
+		std::pmr::vector<domain::BusInfo> bus_infos_;
 
 	};
 
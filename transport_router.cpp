@@ -4,32 +4,34 @@
 
 namespace transport {
 
-	void TransportRouter::FillGraphByStops(const std::map<std::string_view, domain::Stop*>& stops,
-		TransportRouter::Graph& graph) {
-		using namespace std;
-		using namespace graph;
+	graph::VertexId TransportRouter::GetWaitVertex(const domain::Stop* stop) {
+		return stop->id_ * 2;
+	}
 
-		map<string, VertexId> stop_ids;
-		VertexId vertex_id = 0;
+	graph::VertexId TransportRouter::GetBoardVertex(const domain::Stop* stop) {
+		return stop->id_ * 2 + 1;
+	}
 
-		for (const auto& [name, info] : stops) {
-			stop_ids[info->name_] = vertex_id;
+	size_t TransportRouter::GetStopId(graph::VertexId vertex) {
+		return vertex / 2;
+	}
 
+	void TransportRouter::FillGraphByStops(std::span<const domain::Stop> stops,
+		TransportRouter::Graph& graph) {
+
+		for (const auto& stop : stops) {
 			graph.AddEdge({
-				.name = info->name_,
+				.name = std::string(stop.name_),
 				.quality = 0,
-				.from = vertex_id,
-				.to = ++vertex_id,
+				.from = GetWaitVertex(&stop),
+				.to = GetBoardVertex(&stop),
 				.weight = static_cast<double>(settings_.bus_wait_time),
 			});
-
-			++vertex_id;
 		}
-		stop_ids_ = move(stop_ids);
 	}
 
-	void TransportRouter::FillGraphByBus(const std::map<std::string_view, domain::Bus*>& buses,
-		TransportRouter::Graph& graph, const TransportCatalogue& catalogue) {
+	void TransportRouter::FillGraphByBus(std::span<const domain::Bus> buses,
+		TransportRouter::Graph& graph) {
 		using namespace std;
 		using namespace graph;
 
@@ -38,45 +40,61 @@ namespace transport {
 
 		const double AVG_SPEED = ONE_KILOMETER_PER_METER / ONE_HOUR_PER_MINUTES; // скорость, требуемая для прохождения 1 километра за 1 час
 
-		for (const auto& [name, bus] : buses) {
+		for (const auto& bus : buses) {
 
-			const vector<const domain::Stop*>& stops = bus->stops_;
-			size_t stops_count = bus->stops_.size();
+			const auto& stops = bus.stops_;
+			const size_t stops_count = bus.GetRouteSize();
 
-			for (size_t i_from = 0; i_from < stops_count; i_from++) {
+			if (stops_count == 0) {
+				continue;
+			}
 
-				for (size_t i_to = i_from + 1; i_to < stops_count; i_to++) {
+			// Дорожные расстояния перегонов прямого хода в обе стороны запрашиваются один раз:
+			// обратный ход некольцевого маршрута проходит те же перегоны в обратном направлении
+			vector<size_t> hop_ahead(stops.size(), 0);
+			vector<size_t> hop_back(stops.size(), 0);
+			for (size_t i = 1; i < stops.size(); ++i) {
+				hop_ahead[i - 1] = catalogue_.GetDistance(stops[i - 1], stops[i]);
+				hop_back[i - 1] = catalogue_.GetDistance(stops[i], stops[i - 1]);
+			}
 
-					size_t road_distance = 0;
-					size_t road_distance_inverse = 0;
+			// Префиксные суммы расстояний вдоль полной последовательности остановок
+			// по ходу движения и против него
+			vector<size_t> distance_along(stops_count, 0);
+			vector<size_t> distance_against(stops_count, 0);
+			for (size_t i = 1; i < stops_count; ++i) {
+				const bool is_forward = i < stops.size();
+				const size_t hop = is_forward ? i - 1 : stops_count - 1 - i;
 
-					for (size_t i = i_from + 1; i <= i_to; i++) {
+				distance_along[i] = distance_along[i - 1] + (is_forward ? hop_ahead[hop] : hop_back[hop]);
+				distance_against[i] = distance_against[i - 1] + (is_forward ? hop_back[hop] : hop_ahead[hop]);
+			}
 
-						road_distance += catalogue.GetDistance(
-							const_cast<domain::Stop*>(stops[i - 1]),
-							const_cast<domain::Stop*>(stops[i])
-						);
-						road_distance_inverse += catalogue.GetDistance(
-							const_cast<domain::Stop*>(stops[i]),
-							const_cast<domain::Stop*>(stops[i - 1])
-						);
+			for (size_t i_from = 0; i_from < stops_count; i_from++) {
 
-					}
+				const domain::Stop* stop_from = bus.GetRouteStop(i_from);
+
+				for (size_t i_to = i_from + 1; i_to < stops_count; i_to++) {
+
+					const domain::Stop* stop_to = bus.GetRouteStop(i_to);
+
+					const size_t road_distance = distance_along[i_to] - distance_along[i_from];
+					const size_t road_distance_inverse = distance_against[i_to] - distance_against[i_from];
 
 					graph.AddEdge({
-						.name = bus->name_,
+						.name = std::string(bus.name_),
 						.quality = i_to - i_from,
-						.from = stop_ids_.at(stops[i_from]->name_) + 1,
-						.to = stop_ids_.at(stops[i_to]->name_),
+						.from = GetBoardVertex(stop_from),
+						.to = GetWaitVertex(stop_to),
 						.weight = static_cast<double>(road_distance) / (settings_.bus_velocity * (AVG_SPEED))
 						});
 
-					if (!bus->is_circular_) {
+					if (!bus.is_circular_) {
 						graph.AddEdge({
-						.name = bus->name_,
+						.name = std::string(bus.name_),
 						.quality = i_to - i_from,
-						.from = stop_ids_.at(stops[i_to]->name_) + 1,
-						.to = stop_ids_.at(stops[i_from]->name_),
+						.from = GetBoardVertex(stop_to),
+						.to = GetWaitVertex(stop_from),
 						.weight = static_cast<double>(road_distance_inverse) / (settings_.bus_velocity * (AVG_SPEED))
 						});
 					}
@@ -86,18 +104,15 @@ namespace transport {
 		}
 	}
 
-	void TransportRouter::BuildGraph(const TransportCatalogue& catalogue) {
-		using namespace std;
-		using namespace graph;
+	void TransportRouter::BuildGraph() {
+		const auto& buses = catalogue_.GetAllBuses();
+		const auto& stops = catalogue_.GetAllStops();
 
-		const auto& buses = catalogue.GetAllBuses();
-		const auto& stops = catalogue.GetAllStops();
-		
 		Graph graph(stops.size() * 2);
 
 		FillGraphByStops(stops, graph);
 
-		FillGraphByBus(buses, graph, catalogue);
+		FillGraphByBus(buses, graph);
 
 		graph_ = std::move(graph);
 	}
@@ -115,7 +130,14 @@ namespace transport {
 
 	const TransportRouter::TRInfo TransportRouter::FindRoute(const std::string& from, const std::string& to) const {
 
-		std::optional<Router::RouteInfo> temp_info = router_->BuildRoute(stop_ids_.at(from), stop_ids_.at(to));
+		const domain::Stop* stop_from = catalogue_.GetStop(from);
+		const domain::Stop* stop_to = catalogue_.GetStop(to);
+
+		if (!stop_from || !stop_to) {
+			return { {}, std::nullopt };
+		}
+
+		std::optional<Router::RouteInfo> temp_info = router_->BuildRoute(GetWaitVertex(stop_from), GetWaitVertex(stop_to));
 
 		if (!temp_info) {
 			return { {}, temp_info };
@@ -4,8 +4,8 @@
 #include "router.h"
 #include "transport_catalogue.h"
 
-#include <map>
 #include <memory>
+#include <span>
 #include <string>
 
 
@@ -28,31 +28,34 @@ namespace transport
 			std::optional<Router::RouteInfo> info;
 		};
 
-		TransportRouter() = default;
+		TransportRouter(RouterSettings settings, const CatalogueSnapshot& catalogue)
+			: settings_(settings), catalogue_(catalogue) {
 
-		TransportRouter(RouterSettings settings, const TransportCatalogue& catalogue)
-			: settings_(settings){
-
-			BuildGraph(catalogue);
+			BuildGraph();
 			router_ = std::make_unique<Router>(graph_);
 		}
 
 		const TRInfo FindRoute(const std::string& from, const std::string& to) const;
 
+		// Остановка, которой принадлежит вершина графа: у ребра поездки from — остановка посадки, to — высадки
+		static size_t GetStopId(graph::VertexId vertex);
+
 	private:
 		RouterSettings settings_;
+		const CatalogueSnapshot& catalogue_;
 
 		Graph graph_;
-		std::map<std::string, graph::VertexId> stop_ids_;
 		std::unique_ptr<Router> router_;
 
-		void FillGraphByStops(const std::map<std::string_view, domain::Stop*>& stops,
-			Graph& graph);
+		// Остановке с идентификатором id соответствуют вершины ожидания 2 * id и посадки 2 * id + 1
+		static graph::VertexId GetWaitVertex(const domain::Stop* stop);
+		static graph::VertexId GetBoardVertex(const domain::Stop* stop);
+
+		void FillGraphByStops(std::span<const domain::Stop> stops, Graph& graph);
 
-		void FillGraphByBus(const std::map<std::string_view, domain::Bus*>& buses,
-			Graph& graph, const TransportCatalogue& catalogue);
+		void FillGraphByBus(std::span<const domain::Bus> buses, Graph& graph);
 
-		void BuildGraph(const TransportCatalogue& catalogue);
+		void BuildGraph();
 
 		std::vector<graph::Edge<double>> GetEdges(Router::RouteInfo info) const;
 	};